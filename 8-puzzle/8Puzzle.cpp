@@ -8,35 +8,225 @@
  * 7 6 5        7   5        7 6 5          7 5        3 2 1
  *
  * Usage: ./8Puzzle.o {134862705|281043765|281463075|567408321|etc.}
+ *                   [lazy|external [directory]|checkpoint file|frontier|parallel]
+ *        ./8Puzzle.o stream [file]
  *
- * Example: ./8Puzzle.o 281463075
+ * Example: ./8Puzzle.o 281463075 lazy
+ *          ./8Puzzle.o stream boards.txt
+ *
+ * With lazy the sequence score of the heuristic is only computed for nodes popped from the open list, while the
+ * others are ordered by their Manhattan distance.
+ * With external the search keeps its frontier in bucket files in the given directory, the current one by default.
+ * With checkpoint the search is saved to the given file every 1000 steps and resumed from it when the file exists and
+ * holds the same board, so an interrupted run picks up where it stopped; the file is removed once the search is over.
+ * With frontier the search keeps only its last layers and rebuilds an optimal path by divide and conquer.
+ * With parallel every step expands the 8 best open nodes at once on all the cores of the machine.
+ *
+ * With stream the boards are read one per line from the given file, or from the standard input, and solved
+ * concurrently, each worker thread reusing its own search. Boards whose permutation parity differs from the goal's
+ * are reported unsolvable without a search. One line is written per board, in input order: the board followed by the
+ * solution length, the search steps and the milliseconds taken, or by why it was not solved.
  *
  * @author Donato Meoli
  */
 
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <sstream>
 #include "PuzzleState.h"
+#include "../ExternalAStarSearch.h"
+#include "../FrontierSearch.h"
+#include "../ThreadPool.h"
 
-int main(int argc, char *argv[]) {
-    if (argc > 1) {
-        int i = 0, c;
-        while ((c = argv[1][i])) {
-            if (isdigit(c)) {
-                int n = (c - '0');
-                PuzzleState::start[i] = static_cast<PuzzleState::TILE>(n);
-            }
-            i++;
+#define CHECKPOINT_INTERVAL 1000
+#define PARALLEL_BATCH_SIZE 8
+#define STREAM_WINDOW 4096
+
+bool parseBoard(const string &text, PuzzleState::TILE *tiles) {
+    bool placed[BOARD_WIDTH * BOARD_HEIGHT] = {false};
+    int count = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (!isdigit(text[i])) continue;
+        int n = text[i] - '0';
+        if (count == BOARD_WIDTH * BOARD_HEIGHT || n >= BOARD_WIDTH * BOARD_HEIGHT || placed[n]) return false;
+        placed[n] = true;
+        tiles[count++] = static_cast<PuzzleState::TILE>(n);
+    }
+    return count == BOARD_WIDTH * BOARD_HEIGHT;
+}
+
+int solveExternal(PuzzleState &startState, PuzzleState &goalState, const char *directory) {
+    ExternalAStarSearch<PuzzleState> externalSearch(directory);
+    externalSearch.setStartAndGoalStates(startState, goalState);
+    unsigned int searchState;
+    do {
+        searchState = externalSearch.searchStep();
+    } while (searchState == ExternalAStarSearch<PuzzleState>::SEARCH_STATE_SEARCHING);
+    vector<PuzzleState> solution;
+    bool succeeded = searchState == ExternalAStarSearch<PuzzleState>::SEARCH_STATE_SUCCEEDED;
+    if (succeeded && externalSearch.getSolution(solution)) {
+        cout << "Search found goal state..." << endl;
+        cout << "Displaying solution:" << endl;
+        for (size_t i = 0; i < solution.size(); i++) {
+            solution[i].printNodeInfo();
+            cout << endl;
         }
+        cout << "Solution step: " << solution.size() - 1 << endl;
+    } else if (searchState == ExternalAStarSearch<PuzzleState>::SEARCH_STATE_OUT_OF_MEMORY) {
+        cout << "Search terminated. Could not write to " << directory << "!" << endl;
+    } else {
+        cout << "Search terminated. Did not find goal state!" << endl;
     }
-    AStarSearch<PuzzleState> aStarSearch;
-    PuzzleState startState(PuzzleState::start);
+    cout << "Search steps: " << externalSearch.getStepCount() << endl;
+    cout << "Buckets: " << externalSearch.getBucketCount() << endl;
+    cout << "Bytes written: " << externalSearch.getBytesWritten();
+    cout << " (read: " << externalSearch.getBytesRead() << ")" << endl;
+    externalSearch.freeSolutionNodes();
+    return EXIT_SUCCESS;
+}
+
+int solveFrontier(PuzzleState &startState, PuzzleState &goalState) {
+    FrontierSearch<PuzzleState> frontierSearch;
+    frontierSearch.setStartAndGoalStates(startState, goalState);
+    unsigned int searchState;
+    do {
+        searchState = frontierSearch.searchStep();
+    } while (searchState == FrontierSearch<PuzzleState>::SEARCH_STATE_SEARCHING);
+    vector<PuzzleState> solution;
+    if (frontierSearch.getSolution(solution)) {
+        cout << "Search found goal state..." << endl;
+        cout << "Displaying solution:" << endl;
+        for (size_t i = 0; i < solution.size(); i++) {
+            solution[i].printNodeInfo();
+            cout << endl;
+        }
+        cout << "Solution step: " << solution.size() - 1 << endl;
+    } else if (searchState == FrontierSearch<PuzzleState>::SEARCH_STATE_FAILED) {
+        cout << "Search terminated. Did not find goal state!" << endl;
+    } else if (searchState == FrontierSearch<PuzzleState>::SEARCH_STATE_OUT_OF_MEMORY) {
+        cout << "Search terminated. Out of memory!" << endl;
+    }
+    cout << "Search steps: " << frontierSearch.getStepCount() << endl;
+    cout << "Peak stored states: " << frontierSearch.getPeakStoredStates() << endl;
+    return EXIT_SUCCESS;
+}
+
+string solveStreamed(const string &line) {
+    PuzzleState::TILE tiles[BOARD_WIDTH * BOARD_HEIGHT];
+    ostringstream result;
+    if (!parseBoard(line, tiles)) {
+        size_t first = line.find_first_not_of(" \t");
+        size_t last = line.find_last_not_of(" \t\r");
+        result << line.substr(first, last - first + 1) << " invalid";
+        return result.str();
+    }
+    // Written back as digits only, so the columns of every line stay apart whatever separators the input used.
+    for (int i = 0; i < BOARD_WIDTH * BOARD_HEIGHT; i++) result << tiles[i];
+    result << " ";
+    PuzzleState startState(tiles);
     PuzzleState goalState(PuzzleState::goal);
+    if (!startState.isReachable(goalState)) {
+        result << "unsolvable";
+        return result.str();
+    }
+    // Kept by each worker across boards, so the node arrays and the rank table are allocated once per thread.
+    static thread_local AStarSearch<PuzzleState> aStarSearch;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
     aStarSearch.setStartAndGoalStates(startState, goalState);
     unsigned int searchState;
+    do {
+        searchState = aStarSearch.searchStep();
+    } while (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_SEARCHING);
+    int length = -1;
+    if (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_SUCCEEDED) {
+        for (PuzzleState *puzzleState = aStarSearch.getSolutionStart(); puzzleState;
+             puzzleState = aStarSearch.getSolutionNext()) {
+            length++;
+        }
+    }
+    aStarSearch.freeSolutionNodes();
+    double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    if (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_SUCCEEDED) {
+        result << length << " " << aStarSearch.getStepCount() << " " << fixed << setprecision(3) << milliseconds;
+    } else if (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_OUT_OF_MEMORY) {
+        result << "out-of-memory";
+    } else {
+        result << "failed";
+    }
+    return result.str();
+}
+
+int solveStream(istream &input) {
+    ThreadPool threadPool;
+    deque<future<string>> results;
+    string line;
+    while (getline(input, line)) {
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        shared_ptr<packaged_task<string()>> task = make_shared<packaged_task<string()>>(
+                [line] { return solveStreamed(line); });
+        results.push_back(task->get_future());
+        threadPool.enqueue([task] { (*task)(); });
+        // At most a window of boards is in flight, so a file of any size is never held in memory at once.
+        while (results.size() >= STREAM_WINDOW) {
+            cout << results.front().get() << '\n';
+            results.pop_front();
+        }
+    }
+    while (!results.empty()) {
+        cout << results.front().get() << '\n';
+        results.pop_front();
+    }
+    cout.flush();
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "stream") == 0) {
+        ios::sync_with_stdio(false);
+        if (argc < 3) return solveStream(cin);
+        ifstream input(argv[2]);
+        if (!input) {
+            cerr << "Cannot read " << argv[2] << endl;
+            return EXIT_FAILURE;
+        }
+        return solveStream(input);
+    }
+    PuzzleState::TILE tiles[BOARD_WIDTH * BOARD_HEIGHT];
+    memcpy(tiles, PuzzleState::start, sizeof(tiles));
+    if (argc > 1 && !parseBoard(argv[1], tiles)) {
+        cerr << "Invalid board " << argv[1] << endl;
+        return EXIT_FAILURE;
+    }
+    PuzzleState startState(tiles);
+    PuzzleState goalState(PuzzleState::goal);
+    if (argc > 2 && strcmp(argv[2], "external") == 0) {
+        return solveExternal(startState, goalState, argc > 3 ? argv[3] : ".");
+    }
+    if (argc > 2 && strcmp(argv[2], "frontier") == 0) return solveFrontier(startState, goalState);
+    const char *checkpointName = argc > 3 && strcmp(argv[2], "checkpoint") == 0 ? argv[3] : nullptr;
+    AStarSearch<PuzzleState> aStarSearch;
+    aStarSearch.setLazyHeuristic(argc > 2 && strcmp(argv[2], "lazy") == 0);
+    if (argc > 2 && strcmp(argv[2], "parallel") == 0) aStarSearch.setParallelExpansion(PARALLEL_BATCH_SIZE);
+    // A checkpoint left by another board is not resumed, the search starts over and overwrites it.
+    if (checkpointName && aStarSearch.loadCheckpoint(checkpointName) && aStarSearch.getStartState() &&
+        aStarSearch.getStartState()->isSameState(startState)) {
+        cout << "Resuming search after " << aStarSearch.getStepCount() << " steps..." << endl;
+    } else {
+        aStarSearch.setStartAndGoalStates(startState, goalState);
+    }
+    unsigned int searchState;
     unsigned int searchSteps = 0;
     do {
         searchState = aStarSearch.searchStep();
         searchSteps++;
+        if (checkpointName && searchSteps % CHECKPOINT_INTERVAL == 0) aStarSearch.saveCheckpoint(checkpointName);
     } while (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_SEARCHING);
+    if (checkpointName) remove(checkpointName);
     if (searchState == AStarSearch<PuzzleState>::SEARCH_STATE_SUCCEEDED) {
         cout << "Search found goal state..." << endl;
         PuzzleState *puzzleState = aStarSearch.getSolutionStart();
@@ -68,6 +258,8 @@ int main(int argc, char *argv[]) {
         cout << "Search terminated. Out of memory!" << endl;
     }
     cout << "Search steps: " << aStarSearch.getStepCount() << endl;
+    cout << "Heuristic evaluations: " << aStarSearch.getHeuristicEvaluations();
+    cout << " (saved: " << aStarSearch.getHeuristicEvaluationsSaved() << ")" << endl;
     return EXIT_SUCCESS;
 }
 
@@ -1,8 +1,12 @@
 #ifndef PUZZLE_STATE_H
 #define PUZZLE_STATE_H
 
+#include <climits>
 #include <cstring>
 #include <iostream>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "../AStarSearch.h"
 #include "../AStarState.h"
 
@@ -13,7 +17,7 @@
 #define GM_SPACE 0
 #define GM_OFF_BOARD 1
 
-class PuzzleState : public AStarState<PuzzleState> {
+class PuzzleState : public AStarState<PuzzleState, int> {
 
 public:
 
@@ -32,31 +36,71 @@ public:
     static TILE goal[BOARD_WIDTH * BOARD_HEIGHT];
     static TILE start[BOARD_WIDTH * BOARD_HEIGHT];
 
+    static const int PACKED_SIZE = (BOARD_WIDTH * BOARD_HEIGHT + 1) / 2;
+
+    class EstimateBatch {
+
+    public:
+
+        // One plane per square, stride boards apart: the tile on square s of the i-th board is squares[s * stride + i].
+        vector<int> squares;
+        int stride;
+        int count;
+
+        EstimateBatch();
+
+        void clear();
+
+        void append(PuzzleState &state);
+    };
+
     TILE tiles[BOARD_WIDTH * BOARD_HEIGHT];
 
     PuzzleState();
 
     explicit PuzzleState(TILE *paramTiles);
 
-    float goalDistanceEstimate(PuzzleState &nodeGoal) override;
+    PuzzleState(const TILE *paramTiles, int spx, int spy, int tx, int ty);
+
+    int goalDistanceEstimate(PuzzleState &nodeGoal) override;
+
+    int baseDistanceEstimate(PuzzleState &nodeGoal);
+
+    static void goalDistanceEstimateBatch(EstimateBatch &batch, PuzzleState &nodeGoal, int *estimates);
+
+    static unsigned int minimumBatchSize();
+
+    unsigned int tieBreakKey(PuzzleState &nodeGoal);
 
     bool isGoal(PuzzleState &nodeGoal) override;
 
-    bool getSuccessors(AStarSearch<PuzzleState> *aStarSearch, PuzzleState *parentNode) override;
+    bool getSuccessors(SuccessorSink<PuzzleState> *successorSink, PuzzleState *parentNode) override;
 
-    float getCost(PuzzleState &successor) override;
+    int getCost(PuzzleState &successor) override;
 
     bool isSameState(PuzzleState &rhs) override;
 
+    bool isReachable(PuzzleState &nodeGoal);
+
+    unsigned int rank();
+
+    unsigned int rankBound();
+
+    void pack(unsigned char *record);
+
+    void unpack(const unsigned char *record);
+
     void printNodeInfo();
 
 private:
 
     void getSpacePosition(PuzzleState *pn, int *rx, int *ry);
 
-    bool legalMove(TILE *startTiles, TILE *targetTiles, int spx, int spy, int tx, int ty);
+    bool legalMove(const TILE *startTiles, int spx, int spy, int tx, int ty);
 
     int getMap(int x, int y, const TILE* tiles);
+
+    int permutationParity();
 };
 
 PuzzleState::TILE PuzzleState::goal[] = {
@@ -83,6 +127,33 @@ PuzzleState::TILE PuzzleState::start[] = {
         TL_5
 };
 
+PuzzleState::EstimateBatch::EstimateBatch() {
+    stride = 0;
+    count = 0;
+}
+
+void PuzzleState::EstimateBatch::clear() {
+    count = 0;
+}
+
+void PuzzleState::EstimateBatch::append(PuzzleState &state) {
+    if (count == stride) {
+        // Planes grow together, so a board costs one capacity check however many squares it has.
+        int grownStride = max(2 * stride, 8);
+        vector<int> grown(BOARD_WIDTH * BOARD_HEIGHT * grownStride);
+        for (int square = 0; square < BOARD_HEIGHT * BOARD_WIDTH; square++) {
+            copy(squares.begin() + square * stride, squares.begin() + square * stride + count,
+                 grown.begin() + square * grownStride);
+        }
+        squares.swap(grown);
+        stride = grownStride;
+    }
+    for (int square = 0; square < BOARD_HEIGHT * BOARD_WIDTH; square++) {
+        squares[square * stride + count] = state.tiles[square];
+    }
+    count++;
+}
+
 PuzzleState::PuzzleState() {
     memcpy(tiles, goal, sizeof(TILE) * BOARD_WIDTH * BOARD_HEIGHT);
 }
@@ -91,8 +162,14 @@ PuzzleState::PuzzleState(TILE *paramTiles) {
     memcpy(tiles, paramTiles, sizeof(TILE) * BOARD_WIDTH * BOARD_HEIGHT);
 }
 
-float PuzzleState::goalDistanceEstimate(PuzzleState &nodeGoal) {
-    int i, cx, cy, ax, ay, h = 0, s, t;
+PuzzleState::PuzzleState(const TILE *paramTiles, int spx, int spy, int tx, int ty) {
+    memcpy(tiles, paramTiles, sizeof(TILE) * BOARD_WIDTH * BOARD_HEIGHT);
+    tiles[(ty * BOARD_WIDTH) + tx] = paramTiles[(spy * BOARD_WIDTH) + spx];
+    tiles[(spy * BOARD_WIDTH) + spx] = paramTiles[(ty * BOARD_WIDTH) + tx];
+}
+
+int PuzzleState::goalDistanceEstimate(PuzzleState &nodeGoal) {
+    int i, ax, ay, s;
     TILE correctFollowerTo[BOARD_WIDTH * BOARD_HEIGHT] = {
             TL_SPACE,
             TL_2,
@@ -115,30 +192,27 @@ float PuzzleState::goalDistanceEstimate(PuzzleState &nodeGoal) {
             6,
             7
     };
-    int tileX[BOARD_WIDTH * BOARD_HEIGHT] = {
-            1,
-            0,
-            1,
-            2,
-            2,
-            2,
-            1,
-            0,
-            0
-    };
-    int tileY[BOARD_WIDTH * BOARD_HEIGHT] = {
-            1,
-            0,
-            0,
-            0,
-            1,
-            2,
-            2,
-            2,
-            1
-    };
     s = 0;
     if (tiles[(BOARD_HEIGHT * BOARD_WIDTH) / 2] != nodeGoal.tiles[(BOARD_HEIGHT * BOARD_WIDTH) / 2]) s = 1;
+    for (i = 0; i < (BOARD_HEIGHT * BOARD_WIDTH); i++) {
+        if (tiles[i] == TL_SPACE) continue;
+        ax = i % BOARD_WIDTH;
+        ay = i / BOARD_WIDTH;
+        if (ax == (BOARD_WIDTH / 2) && ay == (BOARD_HEIGHT / 2)) continue;
+        if (correctFollowerTo[tiles[i]] != tiles[clockwiseTileOf[i]]) s += 2;
+    }
+    return baseDistanceEstimate(nodeGoal) + 3 * s;
+}
+
+int PuzzleState::baseDistanceEstimate(PuzzleState &nodeGoal) {
+    int i, cx, cy, ax, ay, h = 0;
+    int tileX[BOARD_WIDTH * BOARD_HEIGHT];
+    int tileY[BOARD_WIDTH * BOARD_HEIGHT];
+    // Where each tile sits on the goal board, so any board can be the goal.
+    for (i = 0; i < (BOARD_HEIGHT * BOARD_WIDTH); i++) {
+        tileX[nodeGoal.tiles[i]] = i % BOARD_WIDTH;
+        tileY[nodeGoal.tiles[i]] = i / BOARD_WIDTH;
+    }
     for (i = 0; i < (BOARD_HEIGHT * BOARD_WIDTH); i++) {
         if (tiles[i] == TL_SPACE) continue;
         cx = tileX[tiles[i]];
@@ -147,38 +221,108 @@ float PuzzleState::goalDistanceEstimate(PuzzleState &nodeGoal) {
         ay = i / BOARD_WIDTH;
         // Manhattan distance
         h += abs(cx - ax) + abs(cy - ay);
-        if (ax == (BOARD_WIDTH / 2) && ay == (BOARD_HEIGHT / 2)) continue;
-        if (correctFollowerTo[tiles[i]] != tiles[clockwiseTileOf[i]]) s += 2;
     }
-    t = h + (3 * s);
-    return (float) t;
+    return h;
 }
 
-bool PuzzleState::isGoal(PuzzleState &nodeGoal) {
-    return isSameState(nodeGoal);
+unsigned int PuzzleState::minimumBatchSize() {
+#ifdef __AVX2__
+    // The sequence score outweighs filling the planes from the smallest batch.
+    return 1;
+#else
+    return UINT_MAX;
+#endif
 }
 
-bool PuzzleState::getSuccessors(AStarSearch<PuzzleState> *aStarSearch, PuzzleState *parentNode) {
-    PuzzleState newNode;
-    int spx, spy;
-    getSpacePosition(this, &spx, &spy);
-    if (legalMove(tiles, newNode.tiles, spx, spy, spx, spy-1)) {
-        if (!aStarSearch->addSuccessor(newNode)) return false;
+void PuzzleState::goalDistanceEstimateBatch(EstimateBatch &batch, PuzzleState &nodeGoal, int *estimates) {
+    int count = batch.count;
+    int i = 0;
+#ifdef __AVX2__
+    // The same score as goalDistanceEstimate() for eight boards at a time, one square per step, each square a plain
+    // load from its plane. Tiles 1 to 8 index eight-lane tables of their goal coordinates and correct followers,
+    // looked up with a permute.
+    static const int clockwiseTileOf[BOARD_WIDTH * BOARD_HEIGHT] = {1, 2, 5, 0, -1, 8, 3, 6, 7};
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int goalX[8] = {0};
+    int goalY[8] = {0};
+    for (int square = 0; square < BOARD_HEIGHT * BOARD_WIDTH; square++) {
+        if (nodeGoal.tiles[square] == TL_SPACE) continue;
+        goalX[nodeGoal.tiles[square] - 1] = square % BOARD_WIDTH;
+        goalY[nodeGoal.tiles[square] - 1] = square / BOARD_WIDTH;
     }
-    if (legalMove(tiles, newNode.tiles, spx, spy, spx, spy+1)) {
-        if (!aStarSearch->addSuccessor(newNode)) return false;
+    const __m256i tileX = _mm256_loadu_si256((const __m256i *) goalX);
+    const __m256i tileY = _mm256_loadu_si256((const __m256i *) goalY);
+    const __m256i correctFollowerTo = _mm256_setr_epi32(TL_2, TL_3, TL_4, TL_5, TL_6, TL_7, TL_8, TL_1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i two = _mm256_set1_epi32(2);
+    const int center = (BOARD_HEIGHT * BOARD_WIDTH) / 2;
+    for ( ; i < count; i += 8) {
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lanes);
+        __m256i h = zero;
+        __m256i s = zero;
+        __m256i centerTiles = _mm256_maskload_epi32(&batch.squares[center * batch.stride + i], mask);
+        s = _mm256_andnot_si256(_mm256_cmpeq_epi32(centerTiles, _mm256_set1_epi32(nodeGoal.tiles[center])), one);
+        for (int square = 0; square < BOARD_HEIGHT * BOARD_WIDTH; square++) {
+            __m256i tiles = _mm256_maskload_epi32(&batch.squares[square * batch.stride + i], mask);
+            __m256i isTile = _mm256_andnot_si256(_mm256_cmpeq_epi32(tiles, zero), _mm256_set1_epi32(-1));
+            __m256i index = _mm256_sub_epi32(tiles, one);
+            __m256i cx = _mm256_permutevar8x32_epi32(tileX, index);
+            __m256i cy = _mm256_permutevar8x32_epi32(tileY, index);
+            __m256i dx = _mm256_abs_epi32(_mm256_sub_epi32(cx, _mm256_set1_epi32(square % BOARD_WIDTH)));
+            __m256i dy = _mm256_abs_epi32(_mm256_sub_epi32(cy, _mm256_set1_epi32(square / BOARD_WIDTH)));
+            h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_add_epi32(dx, dy), isTile));
+            if (square == center) continue;
+            const int *follower = &batch.squares[clockwiseTileOf[square] * batch.stride + i];
+            __m256i followers = _mm256_maskload_epi32(follower, mask);
+            __m256i expected = _mm256_permutevar8x32_epi32(correctFollowerTo, index);
+            __m256i wrong = _mm256_andnot_si256(_mm256_cmpeq_epi32(expected, followers), isTile);
+            s = _mm256_add_epi32(s, _mm256_and_si256(wrong, two));
+        }
+        __m256i t = _mm256_add_epi32(h, _mm256_mullo_epi32(s, _mm256_set1_epi32(3)));
+        _mm256_maskstore_epi32(estimates + i, mask, t);
     }
-    if (legalMove(tiles, newNode.tiles, spx, spy, spx-1, spy)) {
-        if (!aStarSearch->addSuccessor(newNode)) return false;
+#endif
+    for ( ; i < count; i++) {
+        PuzzleState board;
+        for (int square = 0; square < BOARD_HEIGHT * BOARD_WIDTH; square++) {
+            board.tiles[square] = static_cast<TILE>(batch.squares[square * batch.stride + i]);
+        }
+        estimates[i] = board.goalDistanceEstimate(nodeGoal);
     }
-    if (legalMove(tiles, newNode.tiles, spx, spy, spx+1, spy)) {
-        if (!aStarSearch->addSuccessor(newNode)) return false;
+}
+
+bool PuzzleState::isGoal(PuzzleState &nodeGoal) {
+    return isSameState(nodeGoal);
+}
+
+bool PuzzleState::getSuccessors(SuccessorSink<PuzzleState> *successorSink, PuzzleState *parentNode) {
+    static const int dx[] = {0, 0, -1, 1};
+    static const int dy[] = {-1, 1, 0, 0};
+    int spx = 0;
+    int spy = 0;
+    int parentX = -1;
+    int parentY = -1;
+    getSpacePosition(this, &spx, &spy);
+    if (parentNode) getSpacePosition(parentNode, &parentX, &parentY);
+    for (int i = 0; i < 4; i++) {
+        int tx = spx + dx[i];
+        int ty = spy + dy[i];
+        // Moving the space back where it came from would only rebuild the parent.
+        if (tx == parentX && ty == parentY) continue;
+        if (!legalMove(tiles, spx, spy, tx, ty)) continue;
+        if (!successorSink->emplaceSuccessor(tiles, spx, spy, tx, ty)) return false;
     }
     return true;
 }
 
-float PuzzleState::getCost(PuzzleState &successor) {
-    return 1.0f;
+unsigned int PuzzleState::tieBreakKey(PuzzleState &nodeGoal) {
+    // Among boards with the same f, the one with fewer moves left by Manhattan distance goes first.
+    return (unsigned int) baseDistanceEstimate(nodeGoal);
+}
+
+int PuzzleState::getCost(PuzzleState &successor) {
+    return 1;
 }
 
 bool PuzzleState::isSameState(PuzzleState &rhs) {
@@ -188,6 +332,50 @@ bool PuzzleState::isSameState(PuzzleState &rhs) {
     return true;
 }
 
+bool PuzzleState::isReachable(PuzzleState &nodeGoal) {
+    // Every move keeps the parity, so half of all boards can never reach the other half.
+    return permutationParity() == nodeGoal.permutationParity();
+}
+
+unsigned int PuzzleState::rank() {
+    // Only boards whose tiles have the same permutation parity are reachable from each other. The Lehmer code of the
+    // tiles, read without the space, alternates parity between consecutive ranks, so halving it numbers the reachable
+    // arrangements densely; the space position completes the rank.
+    int space = 0;
+    unsigned int lehmer = 0;
+    for (int i = 0, n = 0; i < BOARD_HEIGHT * BOARD_WIDTH; i++) {
+        if (tiles[i] == TL_SPACE) {
+            space = i;
+            continue;
+        }
+        int smaller = 0;
+        for (int j = i + 1; j < BOARD_HEIGHT * BOARD_WIDTH; j++) {
+            if (tiles[j] != TL_SPACE && tiles[j] < tiles[i]) smaller++;
+        }
+        lehmer = lehmer * (BOARD_HEIGHT * BOARD_WIDTH - 1 - n) + smaller;
+        n++;
+    }
+    return space * (rankBound() / (BOARD_HEIGHT * BOARD_WIDTH)) + lehmer / 2;
+}
+
+unsigned int PuzzleState::rankBound() {
+    unsigned int bound = 1;
+    for (int i = 2; i <= BOARD_HEIGHT * BOARD_WIDTH; i++) bound *= i;
+    return bound / 2;
+}
+
+void PuzzleState::pack(unsigned char *record) {
+    // Two tiles per byte.
+    memset(record, 0, PACKED_SIZE);
+    for (int i = 0; i < BOARD_HEIGHT * BOARD_WIDTH; i++) record[i / 2] |= (unsigned char) (tiles[i] << ((i % 2) * 4));
+}
+
+void PuzzleState::unpack(const unsigned char *record) {
+    for (int i = 0; i < BOARD_HEIGHT * BOARD_WIDTH; i++) {
+        tiles[i] = static_cast<TILE>((record[i / 2] >> ((i % 2) * 4)) & 0x0F);
+    }
+}
+
 void PuzzleState::printNodeInfo() {
     char str[100];
     sprintf(str, "%c %c %c\n%c %c %c\n%c %c %c\n",
@@ -216,18 +404,8 @@ void PuzzleState::getSpacePosition(PuzzleState *pn, int *rx, int *ry) {
     }
 }
 
-bool PuzzleState::legalMove(TILE *startTiles, TILE *targetTiles, int spx, int spy, int tx, int ty) {
-    if (getMap(spx, spy, startTiles) == GM_SPACE) {
-        if (getMap(tx, ty, startTiles) == GM_TILE) {
-            for (int i = 0; i < (BOARD_HEIGHT * BOARD_WIDTH); i++) {
-                targetTiles[i] = startTiles[i];
-            }
-            targetTiles[(ty * BOARD_WIDTH) + tx] = startTiles[(spy * BOARD_WIDTH) + spx];
-            targetTiles[(spy * BOARD_WIDTH) + spx] = startTiles[(ty * BOARD_WIDTH) + tx];
-            return true;
-        }
-    }
-    return false;
+bool PuzzleState::legalMove(const TILE *startTiles, int spx, int spy, int tx, int ty) {
+    return getMap(spx, spy, startTiles) == GM_SPACE && getMap(tx, ty, startTiles) == GM_TILE;
 }
 
 int PuzzleState::getMap(int x, int y, const TILE *tiles) {
@@ -236,4 +414,19 @@ int PuzzleState::getMap(int x, int y, const TILE *tiles) {
     return GM_TILE;
 }
 
+int PuzzleState::permutationParity() {
+    int inversions = 0;
+    for (int i = 0; i < BOARD_HEIGHT * BOARD_WIDTH; i++) {
+        if (tiles[i] == TL_SPACE) {
+            // A vertical move jumps the space over BOARD_WIDTH - 1 tiles, which flips the parity on even widths.
+            if (BOARD_WIDTH % 2 == 0) inversions += i / BOARD_WIDTH;
+            continue;
+        }
+        for (int j = i + 1; j < BOARD_HEIGHT * BOARD_WIDTH; j++) {
+            if (tiles[j] != TL_SPACE && tiles[j] < tiles[i]) inversions++;
+        }
+    }
+    return inversions % 2;
+}
+
 #endif
@@ -6,22 +6,223 @@
  * Since g(n) gives the path cost from the start node to node n, and h(n) is the estimated cost of the cheapest path
  * from n to the goal, we have f(n) = estimated cost of the cheapest solution through n.
  *
+ * Given a set of goals, the search runs in a single pass with h(n) = min over the goals still to be reached, which is
+ * admissible for each of them. Every goal is settled the first time it is popped from the open list, and the search
+ * goes on until all goals are settled, so their paths share one search tree.
+ *
+ * Nodes live in a structure-of-arrays store addressed by index: states and parent links sit in their own arrays, and
+ * the open list is a binary heap of compact (f, g, index) entries, so heap operations never touch the states. A node
+ * reached again on a cheaper path is updated in place and pushed once more; the stale heap entry is skipped when it
+ * surfaces. The arrays keep their capacity across searches: a finished search gives all nodes back at once, and
+ * getSolution() copies the path into a contiguous buffer before doing so.
+ *
+ * Successors can be constructed in place with emplaceSuccessor() into the SuccessorSink getSuccessors() writes into,
+ * a buffer whose capacity is reused at every expansion, and duplicate checks run against that buffer, so a pruned
+ * successor costs one state construction and no allocation. Only successors that survive become nodes.
+ *
+ * With an expensive heuristic the search can run lazily: nodes enter the open list keyed by g plus the cheap
+ * baseDistanceEstimate() of their state, if it has one, and goalDistanceEstimate() is only called when a node reaches
+ * the top of the open list. A node whose f grows is pushed back instead of expanded, and every node never popped is
+ * a heuristic evaluation saved.
+ *
+ * States may also provide a static goalDistanceEstimateBatch() that estimates several states at once. The state then
+ * declares an EstimateBatch, a structure of arrays of the fields its heuristic reads, which the search fills with the
+ * new nodes of an expansion. The whole batch is handed over in a single call that writes straight into the h array,
+ * and the state can evaluate it with plain SIMD loads instead of gathers across states. Its static minimumBatchSize()
+ * tells how many states a batch needs to beat goalDistanceEstimate() once filling it is paid for; smaller expansions
+ * are estimated one state at a time and never fill the batch.
+ *
+ * States of a dense, enumerable state space may provide rank(), a perfect hash in [0, rankBound()). Duplicates are
+ * then found through a flat rank-to-node table instead of a scan of the node store. Each table slot is stamped with
+ * the generation of the search that wrote it, so clearing the table between searches costs a single increment.
+ *
+ * A search in progress can be saved to a checkpoint file and resumed later, in this process or another one. States are
+ * written with their pack() method and the node arrays as they are, parents included as indices. The open list is
+ * written in heap order, so a resumed search needs no rebuild and expands nodes in the very order the uninterrupted
+ * one would have. The file is written next to its destination and renamed over it, so a crash while saving leaves the
+ * previous checkpoint intact.
+ *
+ * Costs and estimates have the type the state declares through its AStarState base, float unless it says otherwise,
+ * so integral domains add up exactly on every platform. Among open nodes with equal f the search may prefer the
+ * deepest one, the most recently pushed one, or the one with the lowest tieBreakKey() of its state; by default it
+ * takes whichever the heap yields.
+ *
+ * States that know the connected components of their space may provide isReachable(). A goal it rules out is dropped
+ * before the search allocates a single node, so a query with no path fails at once instead of after exhausting every
+ * state reachable from the start.
+ *
+ * When expanding a node and estimating its successors dominate the run time, the search can expand the K best open
+ * nodes of a step at once: their successors are generated, filtered against the node store and estimated on a pool of
+ * worker threads, each batch slot into its own buffer, and then merged into the node store one slot after the other,
+ * in the order the nodes were popped, so the result does not depend on thread timing. Only the first node of a batch
+ * is the best open node, so a goal popped behind it is pushed back unexpanded and accepted only once it comes first,
+ * and a node reached again more cheaply is reopened as usual, which keeps every path the search returns optimal.
+ *
  * @author Donato Meoli
  */
 
 #ifndef A_STAR_SEARCH_H
 #define A_STAR_SEARCH_H
 
+#include <new>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <string>
 #include <vector>
 #include <algorithm>
+#include <type_traits>
+#include "ThreadPool.h"
 
 using namespace std;
 
+template <class S>
+class AStarStateCost {
+
+    template <class T>
+    static typename T::Cost test(typename T::Cost *);
+
+    template <class T>
+    static float test(...);
+
+public:
+
+    typedef decltype(test<S>(nullptr)) type;
+};
+
+template <class S>
+class AStarStateEstimateBatch {
+
+    class None {
+    };
+
+    template <class T>
+    static typename T::EstimateBatch test(typename T::EstimateBatch *);
+
+    template <class T>
+    static None test(...);
+
+public:
+
+    typedef decltype(test<S>(nullptr)) type;
+};
+
+template <class S>
+class AStarStateHasTieBreakKey {
+
+    template <class T>
+    static char test(decltype(&T::tieBreakKey));
+
+    template <class T>
+    static long test(...);
+
+public:
+
+    static const bool value = sizeof(test<S>(nullptr)) == sizeof(char);
+};
+
+template <class S>
+class AStarStateHasReachability {
+
+    template <class T>
+    static char test(decltype(&T::isReachable));
+
+    template <class T>
+    static long test(...);
+
+public:
+
+    static const bool value = sizeof(test<S>(nullptr)) == sizeof(char);
+};
+
+template <class S>
+class AStarStateHasRank {
+
+    template <class T>
+    static char test(decltype(&T::rank), decltype(&T::rankBound));
+
+    template <class T>
+    static long test(...);
+
+public:
+
+    static const bool value = sizeof(test<S>(nullptr, nullptr)) == sizeof(char);
+};
+
+template <class S>
+class AStarStateHasBatchEstimate {
+
+    template <class T>
+    static char test(decltype(&T::goalDistanceEstimateBatch));
+
+    template <class T>
+    static long test(...);
+
+public:
+
+    static const bool value = sizeof(test<S>(nullptr)) == sizeof(char);
+};
+
+template <class S>
+class AStarStateHasBaseEstimate {
+
+    template <class T>
+    static char test(decltype(&T::baseDistanceEstimate));
+
+    template <class T>
+    static long test(...);
+
+public:
+
+    static const bool value = sizeof(test<S>(nullptr)) == sizeof(char);
+};
+
+template <class AStarState>
+class AStarSearch;
+
+// Takes the successors getSuccessors() generates. The search is one itself, and each slot of a parallel expansion has
+// one of its own, so slots expanded at once never share a buffer.
 template <class AStarState>
-class AStarSearch {
+class SuccessorSink {
 
 public:
 
+    bool addSuccessor(AStarState &state);
+
+    template <class... Args>
+    bool emplaceSuccessor(Args&&... args);
+
+private:
+
+    friend class AStarSearch<AStarState>;
+
+    vector<AStarState> successors;
+};
+
+template <class AStarState>
+bool SuccessorSink<AStarState>::addSuccessor(AStarState &state) {
+    successors.push_back(state);
+    return true;
+}
+
+template <class AStarState>
+template <class... Args>
+bool SuccessorSink<AStarState>::emplaceSuccessor(Args&&... args) {
+    try {
+        successors.emplace_back(forward<Args>(args)...);
+    } catch (bad_alloc &) {
+        return false;
+    }
+    return true;
+}
+
+template <class AStarState>
+class AStarSearch : public SuccessorSink<AStarState> {
+
+public:
+
+    typedef typename AStarStateCost<AStarState>::type Cost;
+
     enum {
         SEARCH_STATE_SEARCHING,
         SEARCH_STATE_SUCCEEDED,
@@ -29,37 +230,51 @@ public:
         SEARCH_STATE_OUT_OF_MEMORY
     };
 
-    class Node {
+    enum {
+        NODE_OPEN,
+        NODE_CLOSED
+    };
 
-    public:
+    enum {
+        TIE_BREAKING_NONE,
+        TIE_BREAKING_HIGHER_G,
+        TIE_BREAKING_LIFO,
+        TIE_BREAKING_USER_KEY
+    };
 
-        Node *parent;
-        Node *child;
+    class OpenEntry {
 
-        float g;
-        float h;
-        float f;
+    public:
 
-        AStarState aStarState;
+        Cost f;
+        Cost g;
 
-        Node();
+        int node;
+        unsigned int tie;
     };
 
     class HeapCompare {
     public:
-        bool operator()(const Node *x, const Node *y) const;
+        explicit HeapCompare(unsigned int tieBreaking);
+        bool operator()(const OpenEntry &x, const OpenEntry &y) const;
+    private:
+        unsigned int tieBreaking;
     };
 
     AStarSearch();
 
     void setStartAndGoalStates(AStarState &startState, AStarState &goalState);
 
+    void setStartAndGoalStates(AStarState &startState, vector<AStarState> &goalStates);
+
     unsigned int searchStep();
 
-    bool addSuccessor(AStarState &state);
+    bool expandState(AStarState &aStarState, AStarState *parentState, vector<AStarState> &successorStates);
 
     void freeSolutionNodes();
 
+    bool getSolution(vector<AStarState> &path);
+
     AStarState *getSolutionStart();
     AStarState *getSolutionNext();
     AStarState *getSolutionEnd();
@@ -67,260 +282,1011 @@ public:
 
     int getStepCount();
 
+    AStarState *getStartState();
+
+    void setLazyHeuristic(bool lazyHeuristic);
+
+    void setTieBreaking(unsigned int tieBreaking);
+
+    void setParallelExpansion(unsigned int batchSize, unsigned int threadCount = thread::hardware_concurrency());
+
+    unsigned int getHeuristicEvaluations();
+
+    unsigned int getHeuristicEvaluationsSaved();
+
+    unsigned int getGoalCount();
+
+    bool isGoalSettled(unsigned int goalIndex);
+
+    Cost getGoalCost(unsigned int goalIndex);
+
+    bool getGoalPath(unsigned int goalIndex, vector<AStarState> &path);
+
+    bool saveCheckpoint(const string &fileName);
+
+    // Refuses a checkpoint saved with another setLazyHeuristic() or setTieBreaking() than the current one, so a search
+    // is resumed under the settings it was started with.
+    bool loadCheckpoint(const string &fileName);
+
 private:
 
-    vector<Node*> openList;
-    vector<Node*> closedList;
-    vector<Node*> successors;
+    static const unsigned int CHECKPOINT_MAGIC = 0x41535443;
+    static const unsigned int CHECKPOINT_VERSION = 2;
+
+    typedef integral_constant<bool, AStarStateHasRank<AStarState>::value> HasRank;
+    typedef integral_constant<bool, AStarStateHasBaseEstimate<AStarState>::value> HasBaseEstimate;
+    typedef integral_constant<bool, AStarStateHasBatchEstimate<AStarState>::value> HasBatchEstimate;
+    typedef integral_constant<bool, AStarStateHasTieBreakKey<AStarState>::value> HasTieBreakKey;
+    typedef integral_constant<bool, AStarStateHasReachability<AStarState>::value> HasReachability;
+    typedef typename AStarStateEstimateBatch<AStarState>::type EstimateBatch;
+
+    // A goal node is -1 while the goal is pending and UNREACHABLE_GOAL when isReachable() ruled it out.
+    static const int UNREACHABLE_GOAL = -2;
+
+    class ExpansionBuffer {
+
+    public:
+
+        SuccessorSink<AStarState> sink;
+
+        int node;
+        bool expanded;
+        unsigned int evaluations;
+
+        vector<Cost> costs;
+        vector<Cost> estimates;
+        vector<Cost> batchEstimates;
+        EstimateBatch estimateBatch;
+    };
+
+    using SuccessorSink<AStarState>::successors;
+
+    vector<OpenEntry> openList;
+
+    vector<Cost> nodeG;
+    vector<Cost> nodeH;
+    vector<Cost> batchEstimates;
+    EstimateBatch estimateBatch;
+    vector<unsigned char> nodeLists;
+    vector<unsigned char> nodeEstimated;
+    vector<int> nodeParents;
+    vector<AStarState> nodeStates;
 
     unsigned int state;
     int steps;
 
-    Node *start;
-    Node *goal;
-    Node *currentSolutionNode;
+    AStarState goalState;
+    int goalNode;
+
+    vector<int> solution;
+    size_t currentSolutionNode;
+
+    bool multiGoal;
+    vector<AStarState> goalStates;
+    vector<int> goalNodes;
+    unsigned int goalsSettled;
+    unsigned int goalsUnreachable;
 
-    Node *allocateNode();
+    bool lazyHeuristic;
+    unsigned int tieBreaking;
+    unsigned int pushSequence;
+    unsigned int heuristicEvaluations;
+    unsigned int heuristicsDeferred;
+
+    vector<int> rankNodes;
+    vector<unsigned int> rankGenerations;
+    unsigned int rankGeneration;
+
+    unsigned int expansionBatchSize;
+    unsigned int expansionThreads;
+    vector<ExpansionBuffer> expansionBuffers;
+    vector<OpenEntry> deferredEntries;
+    unique_ptr<ThreadPool> expansionPool;
+
+    bool isReachable(AStarState &startState, AStarState &goalState, true_type);
+    bool isReachable(AStarState &startState, AStarState &goalState, false_type);
+
+    void reserveRanks(AStarState &aStarState, true_type);
+    void reserveRanks(AStarState &aStarState, false_type);
+
+    Cost goalDistanceEstimate(AStarState &aStarState);
+
+    Cost baseDistanceEstimate(AStarState &aStarState, true_type);
+    Cost baseDistanceEstimate(AStarState &aStarState, false_type);
+
+    unsigned int tieBreakKey(AStarState &aStarState, true_type);
+    unsigned int tieBreakKey(AStarState &aStarState, false_type);
+
+    void estimateNode(int node);
+
+    void estimateNodes(int firstNode, int count, true_type);
+    void estimateNodes(int firstNode, int count, false_type);
+
+    void estimateStates(AStarState *states, EstimateBatch &batch, int count, Cost *estimates, vector<Cost> &scratch,
+                        true_type);
+    void estimateStates(AStarState *states, EstimateBatch &batch, int count, Cost *estimates, vector<Cost> &scratch,
+                        false_type);
+
+    bool reestimateNode(int node);
+
+    bool settleGoals(int node);
+
+    bool isPendingGoal(int node);
+
+    unsigned int expandBatch(int first);
+
+    void expandSlots(int firstSlot, int stride, int count);
+
+    void expandSlot(ExpansionBuffer &buffer);
+
+    void pushOpenNode(int node);
+
+    int popOpenNode(OpenEntry &entry);
+
+    int findNode(AStarState &aStarState, true_type);
+    int findNode(AStarState &aStarState, false_type);
+
+    void rankNode(int node, true_type);
+    void rankNode(int node, false_type);
+
+    int allocateNode(AStarState &aStarState);
 
-    void freeNode(Node *node);
-    void freeUnusedNodes();
     void freeAllNodes();
+
+    template <class T>
+    static bool writeArray(FILE *file, const vector<T> &values);
+
+    template <class T>
+    static bool readArray(FILE *file, vector<T> &values, size_t count);
+
+    static bool writeStates(FILE *file, vector<AStarState> &states);
+
+    static bool readStates(FILE *file, vector<AStarState> &states, size_t count);
+
+    bool isNode(int node);
+
+    bool checkLoadedNodes();
+
+    bool checkRanks(true_type);
+    bool checkRanks(false_type);
 };
 
 template <class AStarState>
-AStarSearch<AStarState>::Node::Node() {
-    parent = nullptr;
-    child = nullptr;
-    g = 0.0f;
-    h = 0.0f;
-    h = 0.0f;
+AStarSearch<AStarState>::HeapCompare::HeapCompare(unsigned int tieBreaking) : tieBreaking(tieBreaking) {
 }
 
 template <class AStarState>
-bool AStarSearch<AStarState>::HeapCompare::operator()(const Node *x, const Node *y) const {
-    return x->f > y->f;
+bool AStarSearch<AStarState>::HeapCompare::operator()(const OpenEntry &x, const OpenEntry &y) const {
+    if (x.f != y.f) return x.f > y.f;
+    switch (tieBreaking) {
+        case TIE_BREAKING_HIGHER_G: return x.g < y.g;
+        case TIE_BREAKING_LIFO: return x.tie < y.tie;
+        case TIE_BREAKING_USER_KEY: return x.tie > y.tie;
+        default: return false;
+    }
 }
 
 template <class AStarState>
 AStarSearch<AStarState>::AStarSearch() {
-    currentSolutionNode = nullptr;
+    state = SEARCH_STATE_FAILED;
+    steps = 0;
+    goalNode = -1;
+    currentSolutionNode = 0;
+    multiGoal = false;
+    goalsSettled = 0;
+    goalsUnreachable = 0;
+    lazyHeuristic = false;
+    tieBreaking = TIE_BREAKING_NONE;
+    pushSequence = 0;
+    heuristicEvaluations = 0;
+    heuristicsDeferred = 0;
+    rankGeneration = 1;
+    expansionBatchSize = 1;
+    expansionThreads = 1;
 }
 
 template <class AStarState>
 void AStarSearch<AStarState>::setStartAndGoalStates(AStarState &startState, AStarState &goalState) {
-    start = allocateNode();
-    goal = allocateNode();
-    start->aStarState = startState;
-    goal->aStarState = goalState;
+    freeAllNodes();
+    multiGoal = false;
+    this->goalState = goalState;
+    steps = 0;
+    heuristicEvaluations = 0;
+    heuristicsDeferred = 0;
+    if (!isReachable(startState, goalState, HasReachability())) {
+        state = SEARCH_STATE_FAILED;
+        return;
+    }
+    reserveRanks(startState, HasRank());
+    int start = allocateNode(startState);
+    if (start < 0) {
+        state = SEARCH_STATE_OUT_OF_MEMORY;
+        return;
+    }
     state = SEARCH_STATE_SEARCHING;
-    start->g = 0.0f;
-    start->h = start->aStarState.goalDistanceEstimate(goal->aStarState);
-    start->f = start->g + start->h;
-    start->parent = nullptr;
-    openList.push_back(start);
-    push_heap(openList.begin(), openList.end(), HeapCompare());
+    estimateNode(start);
+    pushOpenNode(start);
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::setStartAndGoalStates(AStarState &startState, vector<AStarState> &goalStates) {
+    freeAllNodes();
+    multiGoal = true;
+    this->goalStates = goalStates;
+    goalNodes.assign(goalStates.size(), -1);
     steps = 0;
+    heuristicEvaluations = 0;
+    heuristicsDeferred = 0;
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (isReachable(startState, goalStates[i], HasReachability())) continue;
+        goalNodes[i] = UNREACHABLE_GOAL;
+        goalsUnreachable++;
+    }
+    if (goalsUnreachable == goalStates.size()) {
+        state = SEARCH_STATE_FAILED;
+        return;
+    }
+    reserveRanks(startState, HasRank());
+    int start = allocateNode(startState);
+    if (start < 0) {
+        state = SEARCH_STATE_OUT_OF_MEMORY;
+        return;
+    }
+    state = SEARCH_STATE_SEARCHING;
+    estimateNode(start);
+    pushOpenNode(start);
 }
 
 template <class AStarState>
 unsigned int AStarSearch<AStarState>::searchStep() {
-    if (state == SEARCH_STATE_SUCCEEDED || state == SEARCH_STATE_FAILED) return state;
-    if (openList.empty()) {
+    if (state != SEARCH_STATE_SEARCHING) return state;
+    OpenEntry entry;
+    int first = popOpenNode(entry);
+    if (first < 0) {
+        if (multiGoal && goalsSettled > 0) {
+            state = SEARCH_STATE_SUCCEEDED;
+            return state;
+        }
         freeAllNodes();
         state = SEARCH_STATE_FAILED;
         return state;
     }
+    if (lazyHeuristic && reestimateNode(first)) {
+        pushOpenNode(first);
+        return state;
+    }
     steps++;
-    Node *first = openList.front();
-    pop_heap(openList.begin(), openList.end(), HeapCompare());
-    openList.pop_back();
-    if (first->aStarState.isGoal(goal->aStarState)) {
-        goal->parent = first->parent;
-        goal->g = first->g;
-        if (!first->aStarState.isSameState(start->aStarState)) {
-            freeNode(first);
-            Node *nodeChild = goal;
-            Node *nodeParent = goal->parent;
-            do {
-                nodeParent->child = nodeChild;
-                nodeChild = nodeParent;
-                nodeParent = nodeParent->parent;
-            } while (nodeChild != start);
-        }
-        freeUnusedNodes();
+    nodeLists[first] = NODE_CLOSED;
+    if (multiGoal && settleGoals(first)) {
         state = SEARCH_STATE_SUCCEEDED;
         return state;
-    } else {
-        successors.clear();
-        if (!first->aStarState.getSuccessors(this, first->parent ? &first->parent->aStarState : nullptr)) {
-            typename vector<Node*>::iterator iterSucc;
-            for (iterSucc = successors.begin(); iterSucc != successors.end(); iterSucc++) freeNode(*iterSucc);
-            successors.clear();
-            freeAllNodes();
-            state = SEARCH_STATE_OUT_OF_MEMORY;
-            return state;
-        }
-        typename vector<Node*>::iterator iterSucc;
-        for (iterSucc = successors.begin(); iterSucc != successors.end(); iterSucc++) {
-            float g = first->g + first->aStarState.getCost((*iterSucc)->aStarState);
-            typename vector<Node*>::iterator iterOpen;
-            for (iterOpen = openList.begin(); iterOpen != openList.end(); iterOpen++) {
-                if ((*iterOpen)->aStarState.isSameState((*iterSucc)->aStarState)) break;
-            }
-            if (iterOpen != openList.end()) {
-                if ((*iterOpen)->g <= g) {
-                    freeNode(*iterSucc);
-                    continue;
-                }
-            }
-            typename vector<Node*>::iterator iterClosed;
-            for (iterClosed = closedList.begin(); iterClosed != closedList.end(); iterClosed++) {
-                if ((*iterClosed)->aStarState.isSameState((*iterSucc)->aStarState)) break;
-            }
-            if (iterClosed != closedList.end()) {
-                if ((*iterClosed)->g <= g) {
-                    freeNode(*iterSucc);
-                    continue;
-                }
-            }
-            (*iterSucc)->parent = first;
-            (*iterSucc)->g = g;
-            (*iterSucc)->h = (*iterSucc)->aStarState.goalDistanceEstimate(goal->aStarState);
-            (*iterSucc)->f = (*iterSucc)->g + (*iterSucc)->h;
-            if (iterClosed != closedList.end()) {
-                freeNode(*iterClosed);
-                closedList.erase(iterClosed);
-            }
-            if (iterOpen != openList.end()) {
-                freeNode(*iterOpen);
-                openList.erase(iterOpen);
-                make_heap(openList.begin(), openList.end(), HeapCompare());
+    }
+    if (!multiGoal && nodeStates[first].isGoal(goalState)) {
+        goalNode = first;
+        for (int node = goalNode; node >= 0; node = nodeParents[node]) solution.push_back(node);
+        reverse(solution.begin(), solution.end());
+        state = SEARCH_STATE_SUCCEEDED;
+        return state;
+    }
+    if (expansionBatchSize > 1) return expandBatch(first);
+    successors.clear();
+    int parent = nodeParents[first];
+    if (!nodeStates[first].getSuccessors(this, parent >= 0 ? &nodeStates[parent] : nullptr)) {
+        freeAllNodes();
+        state = SEARCH_STATE_OUT_OF_MEMORY;
+        return state;
+    }
+    int firstNew = (int) nodeStates.size();
+    for (size_t i = 0; i < successors.size(); i++) {
+        Cost g = nodeG[first] + nodeStates[first].getCost(successors[i]);
+        int node = findNode(successors[i], HasRank());
+        if (node >= 0) {
+            if (nodeG[node] <= g) continue;
+        } else {
+            node = allocateNode(successors[i]);
+            if (node < 0) {
+                freeAllNodes();
+                state = SEARCH_STATE_OUT_OF_MEMORY;
+                return state;
             }
-            openList.push_back(*iterSucc);
-            push_heap(openList.begin(), openList.end(), HeapCompare());
         }
-        closedList.push_back(first);
+        nodeParents[node] = first;
+        nodeG[node] = g;
+        if (node < firstNew) pushOpenNode(node);
+    }
+    int count = (int) nodeStates.size() - firstNew;
+    if (lazyHeuristic) {
+        for (int node = firstNew; node < firstNew + count; node++) estimateNode(node);
+    } else if (count > 0) {
+        estimateNodes(firstNew, count, HasBatchEstimate());
     }
+    for (int node = firstNew; node < firstNew + count; node++) pushOpenNode(node);
     return state;
 }
 
 template <class AStarState>
-bool AStarSearch<AStarState>::addSuccessor(AStarState &state) {
-    Node *node = allocateNode();
-    if (node) {
-        node->aStarState = state;
-        successors.push_back(node);
-        return true;
-    }
-    return false;
+bool AStarSearch<AStarState>::expandState(AStarState &aStarState, AStarState *parentState,
+                                          vector<AStarState> &successorStates) {
+    successors.clear();
+    bool expanded = aStarState.getSuccessors(this, parentState);
+    successorStates.assign(successors.begin(), successors.end());
+    successors.clear();
+    return expanded;
 }
 
 template <class AStarState>
 void AStarSearch<AStarState>::freeSolutionNodes() {
-    Node *node = start;
-    if (start->child) {
-        do {
-            Node *del = node;
-            node = node->child;
-            freeNode(del);
-        } while (node != goal);
-        freeNode(node);
-    } else {
-        freeNode(start);
-        freeNode(goal);
-    }
+    freeAllNodes();
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::getSolution(vector<AStarState> &path) {
+    if (state != SEARCH_STATE_SUCCEEDED || solution.empty()) return false;
+    path.resize(solution.size());
+    for (size_t i = 0; i < solution.size(); i++) path[i] = nodeStates[solution[i]];
+    freeAllNodes();
+    return true;
 }
 
 template <class AStarState>
 AStarState* AStarSearch<AStarState>::getSolutionStart() {
-    currentSolutionNode = start;
-    if (start) {
-        return &start->aStarState;
-    } else {
-        return nullptr;
-    }
+    currentSolutionNode = 0;
+    if (solution.empty()) return nullptr;
+    return &nodeStates[solution[currentSolutionNode]];
 }
 
 template <class AStarState>
 AStarState* AStarSearch<AStarState>::getSolutionNext() {
-    if (currentSolutionNode) {
-        if (currentSolutionNode->child) {
-            Node *child = currentSolutionNode->child;
-            currentSolutionNode = currentSolutionNode->child;
-            return &child->aStarState;
+    if (currentSolutionNode + 1 >= solution.size()) return nullptr;
+    return &nodeStates[solution[++currentSolutionNode]];
+}
+
+template <class AStarState>
+AStarState* AStarSearch<AStarState>::getSolutionEnd() {
+    if (solution.empty()) return nullptr;
+    currentSolutionNode = solution.size() - 1;
+    return &nodeStates[solution[currentSolutionNode]];
+}
+
+template <class AStarState>
+AStarState* AStarSearch<AStarState>::getSolutionPrev() {
+    if (currentSolutionNode == 0 || currentSolutionNode >= solution.size()) return nullptr;
+    return &nodeStates[solution[--currentSolutionNode]];
+}
+
+template <class AStarState>
+int AStarSearch<AStarState>::getStepCount() {
+    return steps;
+}
+
+template <class AStarState>
+AStarState *AStarSearch<AStarState>::getStartState() {
+    // The start state is always the first node allocated.
+    if (nodeStates.empty()) return nullptr;
+    return &nodeStates[0];
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::setLazyHeuristic(bool lazyHeuristic) {
+    this->lazyHeuristic = lazyHeuristic;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::setTieBreaking(unsigned int tieBreaking) {
+    this->tieBreaking = tieBreaking;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::setParallelExpansion(unsigned int batchSize, unsigned int threadCount) {
+    expansionBatchSize = max(batchSize, 1u);
+    expansionThreads = max(min(threadCount, expansionBatchSize), 1u);
+    expansionBuffers.resize(expansionBatchSize);
+    // The calling thread expands a share of every batch itself, so the pool needs one thread less.
+    if (expansionThreads < 2) expansionPool.reset();
+    else if (!expansionPool || expansionPool->getThreadCount() != expansionThreads - 1) {
+        expansionPool.reset(new ThreadPool(expansionThreads - 1));
+    }
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::getHeuristicEvaluations() {
+    return heuristicEvaluations;
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::getHeuristicEvaluationsSaved() {
+    return heuristicsDeferred > heuristicEvaluations ? heuristicsDeferred - heuristicEvaluations : 0;
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::getGoalCount() {
+    return goalNodes.size();
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::isGoalSettled(unsigned int goalIndex) {
+    return goalIndex < goalNodes.size() && goalNodes[goalIndex] >= 0;
+}
+
+template <class AStarState>
+typename AStarSearch<AStarState>::Cost AStarSearch<AStarState>::getGoalCost(unsigned int goalIndex) {
+    return isGoalSettled(goalIndex) ? nodeG[goalNodes[goalIndex]] : Cost(-1);
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::getGoalPath(unsigned int goalIndex, vector<AStarState> &path) {
+    path.clear();
+    if (!isGoalSettled(goalIndex)) return false;
+    for (int node = goalNodes[goalIndex]; node >= 0; node = nodeParents[node]) path.push_back(nodeStates[node]);
+    reverse(path.begin(), path.end());
+    return true;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::saveCheckpoint(const string &fileName) {
+    vector<AStarState> goals = multiGoal ? goalStates : vector<AStarState>(1, goalState);
+    unsigned int header[] = {
+            CHECKPOINT_MAGIC,
+            CHECKPOINT_VERSION,
+            (unsigned int) AStarState::PACKED_SIZE,
+            (unsigned int) sizeof(Cost),
+            state,
+            (unsigned int) steps,
+            multiGoal,
+            lazyHeuristic,
+            heuristicEvaluations,
+            heuristicsDeferred,
+            tieBreaking,
+            pushSequence,
+            goalsSettled,
+            (unsigned int) goalNode,
+            (unsigned int) goals.size(),
+            (unsigned int) nodeStates.size(),
+            (unsigned int) openList.size(),
+            (unsigned int) solution.size()
+    };
+    string temporaryName = fileName + ".tmp";
+    FILE *file = fopen(temporaryName.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+              writeStates(file, goals) &&
+              (!multiGoal || writeArray(file, goalNodes)) &&
+              writeArray(file, nodeG) &&
+              writeArray(file, nodeH) &&
+              writeArray(file, nodeLists) &&
+              writeArray(file, nodeEstimated) &&
+              writeArray(file, nodeParents) &&
+              writeStates(file, nodeStates) &&
+              writeArray(file, openList) &&
+              writeArray(file, solution);
+    if (fclose(file) != 0) ok = false;
+    if (ok) ok = rename(temporaryName.c_str(), fileName.c_str()) == 0;
+    if (!ok) remove(temporaryName.c_str());
+    return ok;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::loadCheckpoint(const string &fileName) {
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file) return false;
+    unsigned int header[18];
+    if (fread(header, sizeof(header), 1, file) != 1 || header[0] != CHECKPOINT_MAGIC ||
+        header[1] != CHECKPOINT_VERSION || header[2] != (unsigned int) AStarState::PACKED_SIZE ||
+        header[3] != (unsigned int) sizeof(Cost) || (header[7] != 0) != lazyHeuristic || header[10] != tieBreaking) {
+        fclose(file);
+        return false;
+    }
+    freeAllNodes();
+    state = header[4];
+    steps = (int) header[5];
+    multiGoal = header[6] != 0;
+    heuristicEvaluations = header[8];
+    heuristicsDeferred = header[9];
+    pushSequence = header[11];
+    goalsSettled = header[12];
+    size_t goalCount = header[14];
+    size_t nodeCount = header[15];
+    // The counts must add up to the length of the file before anything is allocated from them.
+    size_t expected = sizeof(header) + goalCount * AStarState::PACKED_SIZE + (multiGoal ? goalCount * sizeof(int) : 0) +
+                      nodeCount * (2 * sizeof(Cost) + 2 * sizeof(unsigned char) + sizeof(int) +
+                                   AStarState::PACKED_SIZE) +
+                      header[16] * sizeof(OpenEntry) + header[17] * sizeof(int);
+    long length = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    if (length < 0 || (size_t) length != expected || fseek(file, sizeof(header), SEEK_SET) != 0) {
+        fclose(file);
+        state = SEARCH_STATE_FAILED;
+        return false;
+    }
+    vector<AStarState> goals;
+    bool ok = readStates(file, goals, goalCount) &&
+              readArray(file, goalNodes, multiGoal ? goalCount : 0) &&
+              readArray(file, nodeG, nodeCount) &&
+              readArray(file, nodeH, nodeCount) &&
+              readArray(file, nodeLists, nodeCount) &&
+              readArray(file, nodeEstimated, nodeCount) &&
+              readArray(file, nodeParents, nodeCount) &&
+              readStates(file, nodeStates, nodeCount) &&
+              readArray(file, openList, header[16]) &&
+              readArray(file, solution, header[17]);
+    fclose(file);
+    goalNode = (int) header[13];
+    if (!ok || goals.empty() || (!multiGoal && goals.size() != 1) || !checkLoadedNodes() || !checkRanks(HasRank())) {
+        freeAllNodes();
+        state = SEARCH_STATE_FAILED;
+        return false;
+    }
+    goalsUnreachable = (unsigned int) count(goalNodes.begin(), goalNodes.end(), (int) UNREACHABLE_GOAL);
+    if (multiGoal) goalStates = goals;
+    else goalState = goals[0];
+    if (!nodeStates.empty()) reserveRanks(nodeStates[0], HasRank());
+    for (size_t node = 0; node < nodeStates.size(); node++) rankNode((int) node, HasRank());
+    return true;
+}
+
+template <class AStarState>
+template <class T>
+bool AStarSearch<AStarState>::writeArray(FILE *file, const vector<T> &values) {
+    return values.empty() || fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+template <class AStarState>
+template <class T>
+bool AStarSearch<AStarState>::readArray(FILE *file, vector<T> &values, size_t count) {
+    try {
+        values.resize(count);
+    } catch (bad_alloc &) {
+        return false;
+    }
+    return values.empty() || fread(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::writeStates(FILE *file, vector<AStarState> &states) {
+    unsigned char record[AStarState::PACKED_SIZE];
+    for (size_t i = 0; i < states.size(); i++) {
+        states[i].pack(record);
+        if (fwrite(record, sizeof(record), 1, file) != 1) return false;
+    }
+    return true;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::readStates(FILE *file, vector<AStarState> &states, size_t count) {
+    unsigned char record[AStarState::PACKED_SIZE];
+    try {
+        states.resize(count);
+    } catch (bad_alloc &) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fread(record, sizeof(record), 1, file) != 1) return false;
+        states[i].unpack(record);
+    }
+    return true;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::isNode(int node) {
+    return node >= 0 && node < (int) nodeStates.size();
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::checkLoadedNodes() {
+    // Every index read from a checkpoint is checked, so a damaged file is refused instead of read out of bounds.
+    if (state > SEARCH_STATE_OUT_OF_MEMORY) return false;
+    if (goalNode != -1 && !isNode(goalNode)) return false;
+    unsigned int settled = 0;
+    for (size_t i = 0; i < goalNodes.size(); i++) {
+        if (isNode(goalNodes[i])) settled++;
+        else if (goalNodes[i] != -1 && goalNodes[i] != UNREACHABLE_GOAL) return false;
+    }
+    if (settled != goalsSettled) return false;
+    for (size_t node = 0; node < nodeStates.size(); node++) {
+        if (nodeParents[node] != -1 && !isNode(nodeParents[node])) return false;
+        if (nodeLists[node] > NODE_CLOSED) return false;
+    }
+    // Paths are rebuilt by following parents, so they must all end at a root: 1 marks the walk in progress, 2 a node
+    // already known to lead to one.
+    vector<unsigned char> marks(nodeStates.size(), 0);
+    for (size_t node = 0; node < nodeStates.size(); node++) {
+        int current = (int) node;
+        while (current != -1 && marks[current] == 0) {
+            marks[current] = 1;
+            current = nodeParents[current];
+        }
+        if (current != -1 && marks[current] == 1) return false;
+        for (current = (int) node; current != -1 && marks[current] == 1; current = nodeParents[current]) {
+            marks[current] = 2;
         }
     }
-    return nullptr;
+    for (size_t i = 0; i < openList.size(); i++) {
+        if (!isNode(openList[i].node)) return false;
+    }
+    for (size_t i = 0; i < solution.size(); i++) {
+        if (!isNode(solution[i])) return false;
+    }
+    return true;
 }
 
 template <class AStarState>
-AStarState* AStarSearch<AStarState>::getSolutionEnd() {
-    currentSolutionNode = goal;
-    if (goal) {
-        return &goal->aStarState;
+bool AStarSearch<AStarState>::checkRanks(true_type) {
+    // The rank table is sized from the first state, as reserveRanks() does when the checkpoint is accepted.
+    for (size_t node = 0; node < nodeStates.size(); node++) {
+        if (nodeStates[node].rank() >= nodeStates[0].rankBound()) return false;
+    }
+    return true;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::checkRanks(false_type) {
+    return true;
+}
+
+template <class AStarState>
+typename AStarSearch<AStarState>::Cost AStarSearch<AStarState>::goalDistanceEstimate(AStarState &aStarState) {
+    if (!multiGoal) return aStarState.goalDistanceEstimate(goalState);
+    Cost h = Cost();
+    bool first = true;
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] != -1) continue;
+        Cost estimate = aStarState.goalDistanceEstimate(goalStates[i]);
+        if (first || estimate < h) h = estimate;
+        first = false;
+    }
+    return h;
+}
+
+template <class AStarState>
+typename AStarSearch<AStarState>::Cost AStarSearch<AStarState>::baseDistanceEstimate(AStarState &aStarState,
+                                                                                     true_type) {
+    if (!multiGoal) return aStarState.baseDistanceEstimate(goalState);
+    Cost h = Cost();
+    bool first = true;
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] != -1) continue;
+        Cost estimate = aStarState.baseDistanceEstimate(goalStates[i]);
+        if (first || estimate < h) h = estimate;
+        first = false;
+    }
+    return h;
+}
+
+template <class AStarState>
+typename AStarSearch<AStarState>::Cost AStarSearch<AStarState>::baseDistanceEstimate(AStarState &aStarState,
+                                                                                     false_type) {
+    return Cost();
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::tieBreakKey(AStarState &aStarState, true_type) {
+    if (!multiGoal) return aStarState.tieBreakKey(goalState);
+    unsigned int key = 0;
+    bool first = true;
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] != -1) continue;
+        unsigned int goalKey = aStarState.tieBreakKey(goalStates[i]);
+        if (first || goalKey < key) key = goalKey;
+        first = false;
+    }
+    return key;
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::tieBreakKey(AStarState &aStarState, false_type) {
+    return 0;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::estimateNode(int node) {
+    if (lazyHeuristic) {
+        nodeH[node] = baseDistanceEstimate(nodeStates[node], HasBaseEstimate());
+        nodeEstimated[node] = false;
+        heuristicsDeferred++;
     } else {
-        return nullptr;
+        nodeH[node] = goalDistanceEstimate(nodeStates[node]);
+        nodeEstimated[node] = true;
+        heuristicEvaluations++;
     }
 }
 
 template <class AStarState>
-AStarState* AStarSearch<AStarState>::getSolutionPrev() {
-    if (currentSolutionNode) {
-        if (currentSolutionNode->parent) {
-            Node *parent = currentSolutionNode->parent;
-            currentSolutionNode = currentSolutionNode->parent;
-            return &parent->aStarState;
+void AStarSearch<AStarState>::estimateNodes(int firstNode, int count, true_type) {
+    estimateStates(&nodeStates[firstNode], estimateBatch, count, &nodeH[firstNode], batchEstimates, true_type());
+    for (int node = firstNode; node < firstNode + count; node++) nodeEstimated[node] = true;
+    heuristicEvaluations += count;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::estimateNodes(int firstNode, int count, false_type) {
+    for (int node = firstNode; node < firstNode + count; node++) estimateNode(node);
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::estimateStates(AStarState *states, EstimateBatch &batch, int count, Cost *estimates,
+                                             vector<Cost> &scratch, true_type) {
+    if (count < (int) AStarState::minimumBatchSize()) {
+        estimateStates(states, batch, count, estimates, scratch, false_type());
+        return;
+    }
+    batch.clear();
+    for (int state = 0; state < count; state++) batch.append(states[state]);
+    if (!multiGoal) {
+        AStarState::goalDistanceEstimateBatch(batch, goalState, estimates);
+        return;
+    }
+    bool first = true;
+    scratch.resize(count);
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] != -1) continue;
+        AStarState::goalDistanceEstimateBatch(batch, goalStates[i], first ? estimates : &scratch[0]);
+        if (!first) {
+            for (int state = 0; state < count; state++) estimates[state] = min(estimates[state], scratch[state]);
         }
+        first = false;
     }
-    return nullptr;
 }
 
 template <class AStarState>
-int AStarSearch<AStarState>::getStepCount() {
-    return steps;
+void AStarSearch<AStarState>::estimateStates(AStarState *states, EstimateBatch &batch, int count, Cost *estimates,
+                                             vector<Cost> &scratch, false_type) {
+    for (int state = 0; state < count; state++) estimates[state] = goalDistanceEstimate(states[state]);
 }
 
 template <class AStarState>
-typename AStarSearch<AStarState>::Node* AStarSearch<AStarState>::allocateNode() {
-    return new Node;
+bool AStarSearch<AStarState>::reestimateNode(int node) {
+    if (nodeEstimated[node]) return false;
+    Cost h = goalDistanceEstimate(nodeStates[node]);
+    nodeEstimated[node] = true;
+    heuristicEvaluations++;
+    if (h <= nodeH[node]) return false;
+    nodeH[node] = h;
+    return true;
 }
 
 template <class AStarState>
-void AStarSearch<AStarState>::freeNode(Node *node) {
-    delete node;
+bool AStarSearch<AStarState>::settleGoals(int node) {
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] != -1 || !nodeStates[node].isGoal(goalStates[i])) continue;
+        goalNodes[i] = node;
+        goalsSettled++;
+    }
+    return goalsSettled + goalsUnreachable == goalStates.size();
 }
 
 template <class AStarState>
-void AStarSearch<AStarState>::freeUnusedNodes() {
-    typename vector<Node*>::iterator iterOpen;
-    for (iterOpen = openList.begin(); iterOpen != openList.end(); iterOpen++) {
-        if (!(*iterOpen)->child) {
-            freeNode(*iterOpen);
+bool AStarSearch<AStarState>::isPendingGoal(int node) {
+    if (!multiGoal) return nodeStates[node].isGoal(goalState);
+    for (size_t i = 0; i < goalStates.size(); i++) {
+        if (goalNodes[i] == -1 && nodeStates[node].isGoal(goalStates[i])) return true;
+    }
+    return false;
+}
+
+template <class AStarState>
+unsigned int AStarSearch<AStarState>::expandBatch(int first) {
+    int count = 0;
+    expansionBuffers[count++].node = first;
+    deferredEntries.clear();
+    while (count < (int) expansionBatchSize) {
+        OpenEntry entry;
+        int node = popOpenNode(entry);
+        if (node < 0) break;
+        if (lazyHeuristic && reestimateNode(node)) {
+            pushOpenNode(node);
+            continue;
+        }
+        // Only the best open node may be accepted as a goal, and a goal behind it is not that node yet. It goes back
+        // with the entry it was popped with, so its tie against equal nodes is the one a serial search would see.
+        if (isPendingGoal(node)) {
+            deferredEntries.push_back(entry);
+            continue;
         }
+        steps++;
+        nodeLists[node] = NODE_CLOSED;
+        expansionBuffers[count++].node = node;
     }
-    openList.clear();
-    typename vector<Node*>::iterator iterClosed;
-    for (iterClosed = closedList.begin(); iterClosed != closedList.end(); iterClosed++) {
-        if (!(*iterClosed)->child) {
-            freeNode(*iterClosed);
+    for (size_t i = 0; i < deferredEntries.size(); i++) {
+        openList.push_back(deferredEntries[i]);
+        push_heap(openList.begin(), openList.end(), HeapCompare(tieBreaking));
+    }
+    // Nothing is written to the node store until every slot is expanded, so the workers only ever read it.
+    int workers = min(count, (int) expansionThreads);
+    vector<future<void>> expansions;
+    for (int worker = 1; worker < workers; worker++) {
+        shared_ptr<packaged_task<void()>> expansion = make_shared<packaged_task<void()>>(
+                [this, worker, workers, count] { expandSlots(worker, workers, count); });
+        expansions.push_back(expansion->get_future());
+        expansionPool->enqueue([expansion] { (*expansion)(); });
+    }
+    expandSlots(0, workers, count);
+    for (size_t i = 0; i < expansions.size(); i++) expansions[i].get();
+    for (int slot = 0; slot < count; slot++) {
+        ExpansionBuffer &buffer = expansionBuffers[slot];
+        if (!buffer.expanded) {
+            freeAllNodes();
+            state = SEARCH_STATE_OUT_OF_MEMORY;
+            return state;
+        }
+        heuristicEvaluations += buffer.evaluations;
+        vector<AStarState> &states = buffer.sink.successors;
+        for (size_t i = 0; i < states.size(); i++) {
+            // The parent may have been reached more cheaply by an earlier slot, so g is taken as it stands now.
+            Cost g = nodeG[buffer.node] + buffer.costs[i];
+            int node = findNode(states[i], HasRank());
+            if (node >= 0) {
+                if (nodeG[node] <= g) continue;
+                nodeParents[node] = buffer.node;
+                nodeG[node] = g;
+                pushOpenNode(node);
+                continue;
+            }
+            node = allocateNode(states[i]);
+            if (node < 0) {
+                freeAllNodes();
+                state = SEARCH_STATE_OUT_OF_MEMORY;
+                return state;
+            }
+            nodeParents[node] = buffer.node;
+            nodeG[node] = g;
+            if (lazyHeuristic) {
+                estimateNode(node);
+            } else {
+                nodeH[node] = buffer.estimates[i];
+                nodeEstimated[node] = true;
+            }
+            pushOpenNode(node);
         }
     }
-    closedList.clear();
+    return state;
 }
 
 template <class AStarState>
-void AStarSearch<AStarState>::freeAllNodes() {
-    typename vector<Node*>::iterator iterOpen;
-    for (iterOpen = openList.begin(); iterOpen != openList.end(); iterOpen++) {
-        freeNode(*iterOpen);
+void AStarSearch<AStarState>::expandSlots(int firstSlot, int stride, int count) {
+    for (int slot = firstSlot; slot < count; slot += stride) expandSlot(expansionBuffers[slot]);
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::expandSlot(ExpansionBuffer &buffer) {
+    vector<AStarState> &states = buffer.sink.successors;
+    states.clear();
+    buffer.costs.clear();
+    buffer.evaluations = 0;
+    int parent = nodeParents[buffer.node];
+    buffer.expanded = nodeStates[buffer.node].getSuccessors(&buffer.sink,
+                                                             parent >= 0 ? &nodeStates[parent] : nullptr);
+    if (!buffer.expanded) return;
+    try {
+        // Successors already reached as cheaply are dropped here, so only the survivors are estimated.
+        size_t kept = 0;
+        for (size_t i = 0; i < states.size(); i++) {
+            Cost cost = nodeStates[buffer.node].getCost(states[i]);
+            int node = findNode(states[i], HasRank());
+            if (node >= 0 && nodeG[node] <= nodeG[buffer.node] + cost) continue;
+            if (kept != i) states[kept] = states[i];
+            kept++;
+            buffer.costs.push_back(cost);
+        }
+        states.erase(states.begin() + kept, states.end());
+        if (lazyHeuristic || kept == 0) return;
+        buffer.estimates.resize(kept);
+        estimateStates(&states[0], buffer.estimateBatch, (int) kept, &buffer.estimates[0], buffer.batchEstimates,
+                       HasBatchEstimate());
+        buffer.evaluations = (unsigned int) kept;
+    } catch (bad_alloc &) {
+        buffer.expanded = false;
+    }
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::pushOpenNode(int node) {
+    OpenEntry entry;
+    entry.f = nodeG[node] + nodeH[node];
+    entry.g = nodeG[node];
+    entry.node = node;
+    if (tieBreaking == TIE_BREAKING_USER_KEY) entry.tie = tieBreakKey(nodeStates[node], HasTieBreakKey());
+    else entry.tie = pushSequence++;
+    nodeLists[node] = NODE_OPEN;
+    openList.push_back(entry);
+    push_heap(openList.begin(), openList.end(), HeapCompare(tieBreaking));
+}
+
+template <class AStarState>
+int AStarSearch<AStarState>::popOpenNode(OpenEntry &entry) {
+    while (!openList.empty()) {
+        entry = openList.front();
+        pop_heap(openList.begin(), openList.end(), HeapCompare(tieBreaking));
+        openList.pop_back();
+        // Entries left behind by a cheaper path to the same node are skipped.
+        if (nodeLists[entry.node] == NODE_OPEN && nodeG[entry.node] == entry.g) return entry.node;
     }
+    return -1;
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::isReachable(AStarState &startState, AStarState &goalState, true_type) {
+    return startState.isReachable(goalState);
+}
+
+template <class AStarState>
+bool AStarSearch<AStarState>::isReachable(AStarState &startState, AStarState &goalState, false_type) {
+    return true;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::reserveRanks(AStarState &aStarState, true_type) {
+    size_t bound = aStarState.rankBound();
+    if (rankNodes.size() >= bound) return;
+    rankNodes.assign(bound, -1);
+    rankGenerations.assign(bound, 0);
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::reserveRanks(AStarState &aStarState, false_type) {
+}
+
+template <class AStarState>
+int AStarSearch<AStarState>::findNode(AStarState &aStarState, true_type) {
+    size_t rank = aStarState.rank();
+    return rankGenerations[rank] == rankGeneration ? rankNodes[rank] : -1;
+}
+
+template <class AStarState>
+int AStarSearch<AStarState>::findNode(AStarState &aStarState, false_type) {
+    for (size_t node = 0; node < nodeStates.size(); node++) {
+        if (nodeStates[node].isSameState(aStarState)) return (int) node;
+    }
+    return -1;
+}
+
+template <class AStarState>
+int AStarSearch<AStarState>::allocateNode(AStarState &aStarState) {
+    try {
+        nodeStates.push_back(aStarState);
+        nodeParents.push_back(-1);
+        nodeLists.push_back(NODE_OPEN);
+        nodeEstimated.push_back(false);
+        nodeG.push_back(0.0f);
+        nodeH.push_back(0.0f);
+    } catch (bad_alloc &) {
+        return -1;
+    }
+    rankNode((int) nodeStates.size() - 1, HasRank());
+    return (int) nodeStates.size() - 1;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::rankNode(int node, true_type) {
+    size_t rank = nodeStates[node].rank();
+    rankNodes[rank] = node;
+    rankGenerations[rank] = rankGeneration;
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::rankNode(int node, false_type) {
+}
+
+template <class AStarState>
+void AStarSearch<AStarState>::freeAllNodes() {
     openList.clear();
-    typename vector<Node*>::iterator iterClosed;
-    for (iterClosed = closedList.begin(); iterClosed != closedList.end(); iterClosed++) {
-        freeNode(*iterClosed);
+    successors.clear();
+    nodeG.clear();
+    nodeH.clear();
+    nodeLists.clear();
+    nodeEstimated.clear();
+    nodeParents.clear();
+    nodeStates.clear();
+    solution.clear();
+    goalNode = -1;
+    currentSolutionNode = 0;
+    // Goal nodes index the node store, so they go with it and never outlive the search that settled them.
+    goalStates.clear();
+    goalNodes.clear();
+    goalsSettled = 0;
+    goalsUnreachable = 0;
+    if (++rankGeneration == 0) {
+        rankGenerations.assign(rankGenerations.size(), 0);
+        rankGeneration = 1;
     }
-    closedList.clear();
-    freeNode(goal);
 }
 
 #endif
\ No newline at end of file
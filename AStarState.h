@@ -3,18 +3,20 @@
 
 #include "AStarSearch.h"
 
-template <class S>
+template <class S, class C = float>
 class AStarState {
 
 public:
 
-    virtual float goalDistanceEstimate(S &nodeGoal) = 0;
+    typedef C Cost;
+
+    virtual Cost goalDistanceEstimate(S &nodeGoal) = 0;
 
     virtual bool isGoal(S &nodeGoal) = 0;
 
-    virtual bool getSuccessors(AStarSearch<S> *aStarSearch, S *parentNode) = 0;
+    virtual bool getSuccessors(SuccessorSink<S> *successorSink, S *parentNode) = 0;
 
-    virtual float getCost(S &successor) = 0;
+    virtual Cost getCost(S &successor) = 0;
 
     virtual bool isSameState(S &rhs) = 0;
 };
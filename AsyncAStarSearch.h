@@ -0,0 +1,260 @@
+/**
+ * Asynchronous front end to A* Search for callers that cannot block on the searchStep() loop.
+ *
+ * submit() queues a query and returns at once with a future of its result. Queries run to completion on a fixed pool
+ * of worker threads, so thousands of them can be in flight without oversubscribing the machine, and each one borrows
+ * an AStarSearch instance from a free list while it runs: a finished search gives its instance back with the capacity
+ * of its node arrays intact, so later queries do not allocate them again.
+ *
+ * A query stops early when its cancellation token is cancelled or its deadline passes; both are checked before every
+ * step of the search, and the result then reports why it stopped. Cancelling a query still waiting in the queue ends
+ * it as soon as a worker picks it up, before a single node is allocated.
+ *
+ * The state class must be safe to expand from several threads at once, which holds as long as no shared data it reads
+ * changes while queries are running.
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef ASYNC_A_STAR_SEARCH_H
+#define ASYNC_A_STAR_SEARCH_H
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include "AStarSearch.h"
+#include "ThreadPool.h"
+
+template <class AStarState>
+class AsyncAStarSearch {
+
+public:
+
+    enum {
+        SEARCH_STATE_SEARCHING,
+        SEARCH_STATE_SUCCEEDED,
+        SEARCH_STATE_FAILED,
+        SEARCH_STATE_OUT_OF_MEMORY,
+        SEARCH_STATE_CANCELLED,
+        SEARCH_STATE_DEADLINE_EXCEEDED
+    };
+
+    class CancellationToken {
+
+    public:
+
+        CancellationToken();
+
+        void cancel();
+
+        bool isCancelled() const;
+
+    private:
+
+        shared_ptr<atomic<bool>> cancelled;
+    };
+
+    class SearchOptions {
+
+    public:
+
+        SearchOptions();
+
+        CancellationToken cancellationToken;
+        chrono::steady_clock::time_point deadline;
+        bool lazyHeuristic;
+    };
+
+    class SearchResult {
+
+    public:
+
+        unsigned int state;
+        vector<AStarState> path;
+        int steps;
+    };
+
+    explicit AsyncAStarSearch(unsigned int threadCount = thread::hardware_concurrency());
+
+    ~AsyncAStarSearch();
+
+    future<SearchResult> submit(AStarState &startState, AStarState &goalState,
+                                const SearchOptions &options = SearchOptions());
+
+    size_t getIdleSearchCount();
+
+private:
+
+    class Query {
+
+    public:
+
+        AStarState startState;
+        AStarState goalState;
+        SearchOptions options;
+        promise<SearchResult> result;
+    };
+
+    // Ends a query on every way out of run(), exceptions included: the search it borrowed goes back to the free list
+    // and pendingQueries drops, so the destructor never waits for a query that threw.
+    class RunningQuery {
+
+    public:
+
+        explicit RunningQuery(AsyncAStarSearch &owner);
+
+        ~RunningQuery();
+
+        AStarSearch<AStarState> &borrowSearch();
+
+    private:
+
+        AsyncAStarSearch &owner;
+        unique_ptr<AStarSearch<AStarState>> aStarSearch;
+    };
+
+    vector<unique_ptr<AStarSearch<AStarState>>> idleSearches;
+    mutex searchesMutex;
+
+    unsigned int pendingQueries;
+    condition_variable queriesDone;
+
+    // Declared last, so its workers are joined before the free list they give searches back to is destroyed.
+    ThreadPool threadPool;
+
+    void run(shared_ptr<Query> query);
+
+    unique_ptr<AStarSearch<AStarState>> acquireSearch();
+
+    void releaseSearch(unique_ptr<AStarSearch<AStarState>> aStarSearch);
+};
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::CancellationToken::CancellationToken() : cancelled(make_shared<atomic<bool>>(false)) {
+}
+
+template <class AStarState>
+void AsyncAStarSearch<AStarState>::CancellationToken::cancel() {
+    cancelled->store(true);
+}
+
+template <class AStarState>
+bool AsyncAStarSearch<AStarState>::CancellationToken::isCancelled() const {
+    return cancelled->load(memory_order_relaxed);
+}
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::SearchOptions::SearchOptions() {
+    deadline = chrono::steady_clock::time_point::max();
+    lazyHeuristic = false;
+}
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::RunningQuery::RunningQuery(AsyncAStarSearch &owner) : owner(owner) {
+}
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::RunningQuery::~RunningQuery() {
+    // A search stopped halfway still holds its nodes; they are dropped, keeping the capacity, on its next use.
+    if (aStarSearch) owner.releaseSearch(move(aStarSearch));
+    lock_guard<mutex> lock(owner.searchesMutex);
+    if (--owner.pendingQueries == 0) owner.queriesDone.notify_all();
+}
+
+template <class AStarState>
+AStarSearch<AStarState> &AsyncAStarSearch<AStarState>::RunningQuery::borrowSearch() {
+    aStarSearch = owner.acquireSearch();
+    return *aStarSearch;
+}
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::AsyncAStarSearch(unsigned int threadCount) : pendingQueries(0), threadPool(threadCount) {
+}
+
+template <class AStarState>
+AsyncAStarSearch<AStarState>::~AsyncAStarSearch() {
+    unique_lock<mutex> lock(searchesMutex);
+    queriesDone.wait(lock, [this] { return pendingQueries == 0; });
+}
+
+template <class AStarState>
+future<typename AsyncAStarSearch<AStarState>::SearchResult> AsyncAStarSearch<AStarState>::submit(
+        AStarState &startState, AStarState &goalState, const SearchOptions &options) {
+    shared_ptr<Query> query = make_shared<Query>();
+    query->startState = startState;
+    query->goalState = goalState;
+    query->options = options;
+    future<SearchResult> result = query->result.get_future();
+    {
+        lock_guard<mutex> lock(searchesMutex);
+        pendingQueries++;
+    }
+    threadPool.enqueue([this, query] { run(query); });
+    return result;
+}
+
+template <class AStarState>
+size_t AsyncAStarSearch<AStarState>::getIdleSearchCount() {
+    lock_guard<mutex> lock(searchesMutex);
+    return idleSearches.size();
+}
+
+template <class AStarState>
+void AsyncAStarSearch<AStarState>::run(shared_ptr<Query> query) {
+    RunningQuery runningQuery(*this);
+    SearchResult result;
+    result.steps = 0;
+    const SearchOptions &options = query->options;
+    if (options.cancellationToken.isCancelled()) {
+        result.state = SEARCH_STATE_CANCELLED;
+    } else if (chrono::steady_clock::now() >= options.deadline) {
+        result.state = SEARCH_STATE_DEADLINE_EXCEEDED;
+    } else {
+        try {
+            AStarSearch<AStarState> &aStarSearch = runningQuery.borrowSearch();
+            aStarSearch.setLazyHeuristic(options.lazyHeuristic);
+            aStarSearch.setStartAndGoalStates(query->startState, query->goalState);
+            bool unbounded = options.deadline == chrono::steady_clock::time_point::max();
+            do {
+                result.state = aStarSearch.searchStep();
+                if (result.state != SEARCH_STATE_SEARCHING) break;
+                if (options.cancellationToken.isCancelled()) result.state = SEARCH_STATE_CANCELLED;
+                else if (!unbounded && chrono::steady_clock::now() >= options.deadline) {
+                    result.state = SEARCH_STATE_DEADLINE_EXCEEDED;
+                }
+            } while (result.state == SEARCH_STATE_SEARCHING);
+            result.steps = aStarSearch.getStepCount();
+            if (result.state == SEARCH_STATE_SUCCEEDED) aStarSearch.getSolution(result.path);
+        } catch (bad_alloc &) {
+            result.state = SEARCH_STATE_OUT_OF_MEMORY;
+            result.path.clear();
+        }
+    }
+    query->result.set_value(move(result));
+}
+
+template <class AStarState>
+unique_ptr<AStarSearch<AStarState>> AsyncAStarSearch<AStarState>::acquireSearch() {
+    {
+        lock_guard<mutex> lock(searchesMutex);
+        if (!idleSearches.empty()) {
+            unique_ptr<AStarSearch<AStarState>> aStarSearch = move(idleSearches.back());
+            idleSearches.pop_back();
+            return aStarSearch;
+        }
+    }
+    return unique_ptr<AStarSearch<AStarState>>(new AStarSearch<AStarState>());
+}
+
+template <class AStarState>
+void AsyncAStarSearch<AStarState>::releaseSearch(unique_ptr<AStarSearch<AStarState>> aStarSearch) {
+    lock_guard<mutex> lock(searchesMutex);
+    try {
+        idleSearches.push_back(move(aStarSearch));
+    } catch (bad_alloc &) {
+        // Runs from a destructor, so an instance the free list has no room for is simply freed.
+    }
+}
+
+#endif
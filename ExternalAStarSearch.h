@@ -0,0 +1,491 @@
+/**
+ * External-memory A* Search with delayed duplicate detection, after Edelkamp, Jabbar and Schrodl.
+ *
+ * The search keeps no node store in memory. States are packed into fixed-size records, each followed by the packed
+ * state of its parent, and appended to a bucket file on disk chosen by the (g, h) values of the record. Buckets are
+ * expanded in order of f = g + h, and of g within the same f, so costs and estimates must be integral and the
+ * heuristic consistent for the first goal found to be optimal; an inconsistent one still finds a path. States that
+ * provide the cheap baseDistanceEstimate() are bucketed with it and the others with goalDistanceEstimate().
+ *
+ * Duplicates are not looked up when a successor is generated but when its bucket is expanded: the bucket is sorted
+ * in runs that fit the memory limit, the runs are merged with the duplicates inside the bucket dropped, and the merge
+ * is streamed against the already expanded buckets with the same h and a g no greater, which hold every earlier copy
+ * of a state that could reach this bucket. The records that survive are written to the sorted file of the bucket and
+ * expanded, so every file is read and written sequentially through large buffers.
+ *
+ * The path is rebuilt backwards from the goal: the parent of each record lies in the expanded bucket given by the
+ * cost of the move and the estimate of the parent, where it is found by binary search on the sorted file. The start
+ * record is the one that is its own parent.
+ *
+ * States provide a PACKED_SIZE constant, pack() to write themselves into that many bytes and unpack() to read them
+ * back; records are ordered by their bytes, so two states are the same state exactly when they pack alike.
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef EXTERNAL_A_STAR_SEARCH_H
+#define EXTERNAL_A_STAR_SEARCH_H
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <string>
+#include <unistd.h>
+#include "AStarSearch.h"
+
+template <class AStarState>
+class ExternalAStarSearch {
+
+public:
+
+    enum {
+        SEARCH_STATE_SEARCHING,
+        SEARCH_STATE_SUCCEEDED,
+        SEARCH_STATE_FAILED,
+        SEARCH_STATE_OUT_OF_MEMORY
+    };
+
+    static const size_t IO_BUFFER_SIZE = 1 << 20;
+    static const size_t RECORD_SIZE = 2 * AStarState::PACKED_SIZE;
+
+    explicit ExternalAStarSearch(const string &directory, size_t memoryLimit = 64 << 20);
+
+    ~ExternalAStarSearch();
+
+    void setStartAndGoalStates(AStarState &startState, AStarState &goalState);
+
+    unsigned int searchStep();
+
+    bool getSolution(vector<AStarState> &path);
+
+    void freeSolutionNodes();
+
+    unsigned long getStepCount();
+
+    unsigned long getBucketCount();
+
+    unsigned long long getBytesRead();
+
+    unsigned long long getBytesWritten();
+
+private:
+
+    class Bucket {
+
+    public:
+
+        string pendingName;
+        FILE *pendingFile;
+        unsigned long pendingRecords;
+
+        vector<string> sortedNames;
+    };
+
+    class RecordReader {
+
+    public:
+
+        FILE *file;
+        vector<char> buffer;
+        unsigned char record[RECORD_SIZE];
+        bool valid;
+    };
+
+    class RunCompare {
+    public:
+        bool operator()(const RecordReader *x, const RecordReader *y) const;
+    };
+
+    // Buckets are keyed by (f, g), which is the order they are expanded in; h is f - g.
+    typedef pair<int, int> BucketKey;
+
+    typedef integral_constant<bool, AStarStateHasBaseEstimate<AStarState>::value> HasBaseEstimate;
+
+    string directory;
+    size_t memoryLimit;
+
+    map<BucketKey, Bucket> buckets;
+
+    AStarSearch<AStarState> expander;
+    vector<AStarState> successors;
+
+    AStarState goal;
+    unsigned char goalRecord[RECORD_SIZE];
+    BucketKey goalKey;
+
+    unsigned int state;
+    unsigned long steps;
+    unsigned long fileSerial;
+
+    unsigned long long bytesRead;
+    unsigned long long bytesWritten;
+
+    int heuristic(AStarState &aStarState, true_type);
+    int heuristic(AStarState &aStarState, false_type);
+
+    FILE *openFile(const string &name, const char *mode);
+
+    string newFileName(const BucketKey &key, const char *kind);
+
+    bool appendRecord(const BucketKey &key, const unsigned char *record);
+
+    bool openReader(RecordReader &reader, const string &name);
+
+    bool readRecord(RecordReader &reader);
+
+    void closeReader(RecordReader &reader);
+
+    bool sortRuns(Bucket &bucket, const BucketKey &key, vector<string> &runNames);
+
+    bool expandBucket(const BucketKey &key);
+
+    bool expandRecord(const unsigned char *record, const BucketKey &key);
+
+    bool findRecord(const BucketKey &key, const unsigned char *packedState, unsigned char *record);
+
+    void removeFiles();
+};
+
+template <class AStarState>
+const size_t ExternalAStarSearch<AStarState>::IO_BUFFER_SIZE;
+
+template <class AStarState>
+const size_t ExternalAStarSearch<AStarState>::RECORD_SIZE;
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::RunCompare::operator()(const RecordReader *x, const RecordReader *y) const {
+    return memcmp(x->record, y->record, AStarState::PACKED_SIZE) > 0;
+}
+
+template <class AStarState>
+ExternalAStarSearch<AStarState>::ExternalAStarSearch(const string &directory, size_t memoryLimit) :
+    directory(directory),
+    memoryLimit(max(memoryLimit, RECORD_SIZE)),
+    state(SEARCH_STATE_FAILED),
+    steps(0),
+    fileSerial(0),
+    bytesRead(0),
+    bytesWritten(0) {
+}
+
+template <class AStarState>
+ExternalAStarSearch<AStarState>::~ExternalAStarSearch() {
+    removeFiles();
+}
+
+template <class AStarState>
+void ExternalAStarSearch<AStarState>::setStartAndGoalStates(AStarState &startState, AStarState &goalState) {
+    removeFiles();
+    goal = goalState;
+    steps = 0;
+    bytesRead = 0;
+    bytesWritten = 0;
+    // The start record is its own parent: the path ends at the record with g = 0.
+    unsigned char record[RECORD_SIZE];
+    startState.pack(record);
+    startState.pack(record + AStarState::PACKED_SIZE);
+    int h = heuristic(startState, HasBaseEstimate());
+    state = appendRecord(BucketKey(h, 0), record) ? SEARCH_STATE_SEARCHING : SEARCH_STATE_OUT_OF_MEMORY;
+}
+
+template <class AStarState>
+unsigned int ExternalAStarSearch<AStarState>::searchStep() {
+    if (state != SEARCH_STATE_SEARCHING) return state;
+    // One bucket per step: the first one, in (f, g) order, with records still to expand.
+    typename map<BucketKey, Bucket>::iterator it = buckets.begin();
+    while (it != buckets.end() && !it->second.pendingRecords) ++it;
+    if (it == buckets.end()) {
+        state = SEARCH_STATE_FAILED;
+        return state;
+    }
+    if (!expandBucket(it->first)) state = SEARCH_STATE_OUT_OF_MEMORY;
+    return state;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::getSolution(vector<AStarState> &path) {
+    path.clear();
+    if (state != SEARCH_STATE_SUCCEEDED) return false;
+    unsigned char record[RECORD_SIZE];
+    memcpy(record, goalRecord, RECORD_SIZE);
+    BucketKey key = goalKey;
+    for ( ; ; ) {
+        AStarState child;
+        child.unpack(record);
+        path.push_back(child);
+        if (memcmp(record, record + AStarState::PACKED_SIZE, AStarState::PACKED_SIZE) == 0) break;
+        AStarState parent;
+        parent.unpack(record + AStarState::PACKED_SIZE);
+        int g = key.second - (int) parent.getCost(child);
+        key = BucketKey(g + heuristic(parent, HasBaseEstimate()), g);
+        unsigned char packedParent[AStarState::PACKED_SIZE];
+        memcpy(packedParent, record + AStarState::PACKED_SIZE, AStarState::PACKED_SIZE);
+        if (!findRecord(key, packedParent, record)) {
+            path.clear();
+            return false;
+        }
+    }
+    reverse(path.begin(), path.end());
+    return true;
+}
+
+template <class AStarState>
+void ExternalAStarSearch<AStarState>::freeSolutionNodes() {
+    removeFiles();
+}
+
+template <class AStarState>
+unsigned long ExternalAStarSearch<AStarState>::getStepCount() {
+    return steps;
+}
+
+template <class AStarState>
+unsigned long ExternalAStarSearch<AStarState>::getBucketCount() {
+    return buckets.size();
+}
+
+template <class AStarState>
+unsigned long long ExternalAStarSearch<AStarState>::getBytesRead() {
+    return bytesRead;
+}
+
+template <class AStarState>
+unsigned long long ExternalAStarSearch<AStarState>::getBytesWritten() {
+    return bytesWritten;
+}
+
+template <class AStarState>
+int ExternalAStarSearch<AStarState>::heuristic(AStarState &aStarState, true_type) {
+    return (int) aStarState.baseDistanceEstimate(goal);
+}
+
+template <class AStarState>
+int ExternalAStarSearch<AStarState>::heuristic(AStarState &aStarState, false_type) {
+    return (int) aStarState.goalDistanceEstimate(goal);
+}
+
+template <class AStarState>
+FILE *ExternalAStarSearch<AStarState>::openFile(const string &name, const char *mode) {
+    FILE *file = fopen(name.c_str(), mode);
+    if (file) setvbuf(file, nullptr, _IOFBF, IO_BUFFER_SIZE);
+    return file;
+}
+
+template <class AStarState>
+string ExternalAStarSearch<AStarState>::newFileName(const BucketKey &key, const char *kind) {
+    char name[128];
+    // The process id keeps searches of different processes apart, whose addresses may well coincide.
+    snprintf(name, sizeof(name), "/astar-%ld-%p-%d-%d-%s-%lu.dat", (long) getpid(), (void *) this, key.second,
+             key.first - key.second, kind, fileSerial++);
+    return directory + name;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::appendRecord(const BucketKey &key, const unsigned char *record) {
+    Bucket &bucket = buckets[key];
+    if (!bucket.pendingFile) {
+        bucket.pendingName = newFileName(key, "pending");
+        bucket.pendingFile = openFile(bucket.pendingName, "wb");
+        if (!bucket.pendingFile) return false;
+    }
+    if (fwrite(record, RECORD_SIZE, 1, bucket.pendingFile) != 1) return false;
+    bucket.pendingRecords++;
+    bytesWritten += RECORD_SIZE;
+    return true;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::openReader(RecordReader &reader, const string &name) {
+    reader.file = fopen(name.c_str(), "rb");
+    reader.valid = false;
+    if (!reader.file) return false;
+    reader.buffer.resize(IO_BUFFER_SIZE);
+    setvbuf(reader.file, reader.buffer.data(), _IOFBF, reader.buffer.size());
+    return readRecord(reader) || !ferror(reader.file);
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::readRecord(RecordReader &reader) {
+    reader.valid = fread(reader.record, RECORD_SIZE, 1, reader.file) == 1;
+    if (reader.valid) bytesRead += RECORD_SIZE;
+    return reader.valid;
+}
+
+template <class AStarState>
+void ExternalAStarSearch<AStarState>::closeReader(RecordReader &reader) {
+    if (reader.file) fclose(reader.file);
+    reader.file = nullptr;
+    reader.valid = false;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::sortRuns(Bucket &bucket, const BucketKey &key, vector<string> &runNames) {
+    if (fclose(bucket.pendingFile) != 0) return false;
+    bucket.pendingFile = nullptr;
+    FILE *pending = openFile(bucket.pendingName, "rb");
+    if (!pending) return false;
+    // Each run is as many records as fit the memory limit, sorted through an index so records are never swapped.
+    size_t runRecords = memoryLimit / RECORD_SIZE;
+    vector<unsigned char> records(min<unsigned long>(runRecords, bucket.pendingRecords) * RECORD_SIZE);
+    vector<unsigned int> order;
+    bool ok = true;
+    for (unsigned long left = bucket.pendingRecords; left && ok; ) {
+        size_t count = min<unsigned long>(runRecords, left);
+        if (fread(records.data(), RECORD_SIZE, count, pending) != count) {
+            ok = false;
+            break;
+        }
+        bytesRead += count * RECORD_SIZE;
+        left -= count;
+        order.resize(count);
+        for (size_t i = 0; i < count; i++) order[i] = (unsigned int) i;
+        const unsigned char *base = records.data();
+        sort(order.begin(), order.end(), [base](unsigned int x, unsigned int y) {
+            return memcmp(base + x * RECORD_SIZE, base + y * RECORD_SIZE, AStarState::PACKED_SIZE) < 0;
+        });
+        runNames.push_back(newFileName(key, "run"));
+        FILE *run = openFile(runNames.back(), "wb");
+        if (!run) {
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = fwrite(base + order[i] * RECORD_SIZE, RECORD_SIZE, 1, run) == 1;
+        }
+        bytesWritten += count * RECORD_SIZE;
+        if (fclose(run) != 0) ok = false;
+    }
+    fclose(pending);
+    remove(bucket.pendingName.c_str());
+    bucket.pendingRecords = 0;
+    return ok;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::expandBucket(const BucketKey &key) {
+    Bucket &bucket = buckets[key];
+    vector<string> runNames;
+    bool ok = sortRuns(bucket, key, runNames);
+    // Every earlier copy of these states with no greater cost lies in an expanded bucket with the same h.
+    int h = key.first - key.second;
+    vector<string> previousNames;
+    for (int g = 0; g <= key.second; g++) {
+        typename map<BucketKey, Bucket>::iterator it = buckets.find(BucketKey(g + h, g));
+        if (it == buckets.end()) continue;
+        previousNames.insert(previousNames.end(), it->second.sortedNames.begin(), it->second.sortedNames.end());
+    }
+    vector<RecordReader> runs(runNames.size());
+    vector<RecordReader> previous(previousNames.size());
+    priority_queue<RecordReader *, vector<RecordReader *>, RunCompare> merge;
+    for (size_t i = 0; i < runs.size() && ok; i++) {
+        ok = openReader(runs[i], runNames[i]);
+        if (runs[i].valid) merge.push(&runs[i]);
+    }
+    for (size_t i = 0; i < previous.size() && ok; i++) ok = openReader(previous[i], previousNames[i]);
+    string sortedName = newFileName(key, "sorted");
+    FILE *sorted = ok ? openFile(sortedName, "wb") : nullptr;
+    ok = ok && sorted;
+    unsigned char last[AStarState::PACKED_SIZE];
+    bool hasLast = false;
+    while (ok && !merge.empty() && state == SEARCH_STATE_SEARCHING) {
+        RecordReader *run = merge.top();
+        merge.pop();
+        unsigned char record[RECORD_SIZE];
+        memcpy(record, run->record, RECORD_SIZE);
+        if (readRecord(*run)) merge.push(run);
+        else if (ferror(run->file)) ok = false;
+        if (hasLast && memcmp(last, record, AStarState::PACKED_SIZE) == 0) continue;
+        memcpy(last, record, AStarState::PACKED_SIZE);
+        hasLast = true;
+        bool duplicate = false;
+        for (size_t i = 0; i < previous.size(); i++) {
+            while (previous[i].valid && memcmp(previous[i].record, record, AStarState::PACKED_SIZE) < 0) {
+                readRecord(previous[i]);
+            }
+            if (previous[i].valid && memcmp(previous[i].record, record, AStarState::PACKED_SIZE) == 0) {
+                duplicate = true;
+            }
+        }
+        if (duplicate) continue;
+        ok = fwrite(record, RECORD_SIZE, 1, sorted) == 1;
+        bytesWritten += RECORD_SIZE;
+        ok = ok && expandRecord(record, key);
+    }
+    for (size_t i = 0; i < runs.size(); i++) {
+        closeReader(runs[i]);
+        remove(runNames[i].c_str());
+    }
+    for (size_t i = 0; i < previous.size(); i++) closeReader(previous[i]);
+    if (sorted && fclose(sorted) != 0) ok = false;
+    if (sorted) bucket.sortedNames.push_back(sortedName);
+    return ok;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::expandRecord(const unsigned char *record, const BucketKey &key) {
+    AStarState aStarState;
+    aStarState.unpack(record);
+    if (aStarState.isGoal(goal)) {
+        memcpy(goalRecord, record, RECORD_SIZE);
+        goalKey = key;
+        state = SEARCH_STATE_SUCCEEDED;
+        return true;
+    }
+    AStarState parent;
+    parent.unpack(record + AStarState::PACKED_SIZE);
+    if (!expander.expandState(aStarState, key.second ? &parent : nullptr, successors)) return false;
+    steps++;
+    unsigned char successorRecord[RECORD_SIZE];
+    memcpy(successorRecord + AStarState::PACKED_SIZE, record, AStarState::PACKED_SIZE);
+    for (size_t i = 0; i < successors.size(); i++) {
+        int g = key.second + (int) aStarState.getCost(successors[i]);
+        successors[i].pack(successorRecord);
+        if (!appendRecord(BucketKey(g + heuristic(successors[i], HasBaseEstimate()), g), successorRecord)) return false;
+    }
+    return true;
+}
+
+template <class AStarState>
+bool ExternalAStarSearch<AStarState>::findRecord(const BucketKey &key, const unsigned char *packedState,
+                                                 unsigned char *record) {
+    typename map<BucketKey, Bucket>::iterator it = buckets.find(key);
+    if (it == buckets.end()) return false;
+    for (size_t i = 0; i < it->second.sortedNames.size(); i++) {
+        FILE *file = fopen(it->second.sortedNames[i].c_str(), "rb");
+        if (!file) return false;
+        fseek(file, 0, SEEK_END);
+        long low = 0;
+        long high = ftell(file) / (long) RECORD_SIZE;
+        while (low < high) {
+            long middle = low + (high - low) / 2;
+            fseek(file, middle * (long) RECORD_SIZE, SEEK_SET);
+            if (fread(record, RECORD_SIZE, 1, file) != 1) break;
+            bytesRead += RECORD_SIZE;
+            int order = memcmp(record, packedState, AStarState::PACKED_SIZE);
+            if (order == 0) {
+                fclose(file);
+                return true;
+            }
+            if (order < 0) low = middle + 1;
+            else high = middle;
+        }
+        fclose(file);
+    }
+    return false;
+}
+
+template <class AStarState>
+void ExternalAStarSearch<AStarState>::removeFiles() {
+    for (typename map<BucketKey, Bucket>::iterator it = buckets.begin(); it != buckets.end(); ++it) {
+        if (it->second.pendingFile) {
+            fclose(it->second.pendingFile);
+            remove(it->second.pendingName.c_str());
+        }
+        for (size_t i = 0; i < it->second.sortedNames.size(); i++) remove(it->second.sortedNames[i].c_str());
+    }
+    buckets.clear();
+    fileSerial = 0;
+}
+
+#endif
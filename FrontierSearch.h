@@ -0,0 +1,328 @@
+/**
+ * Divide-and-conquer breadth-first heuristic search, after Zhou and Hansen.
+ *
+ * For unit-cost domains whose moves can be undone, the search runs breadth-first and prunes every state whose
+ * f = depth + h exceeds an upper bound. A state generated again can only sit in the layer before, the same layer or
+ * the next one, so duplicates are found against those and every older layer is dropped: memory follows the width of
+ * the frontier instead of the number of states ever reached. Without an upper bound the search starts from the
+ * estimate of the start state and raises the bound to the smallest f it pruned each time a pass fails.
+ *
+ * No parent links are kept. Every state past a relay layer halfway to the bound carries the state it descends from
+ * in that layer, so the goal reveals a midpoint of an optimal path; both halves are then solved the same way with
+ * their exact length as the bound, down to single moves.
+ *
+ * States provide a PACKED_SIZE constant, pack() and unpack(); layers are sorted arrays of packed records, so two states
+ * are the same state exactly when they pack alike. Pruning is only safe with an admissible heuristic, so states that
+ * provide the cheap baseDistanceEstimate() are pruned with it and the others with goalDistanceEstimate().
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef FRONTIER_SEARCH_H
+#define FRONTIER_SEARCH_H
+
+#include <cstring>
+#include <climits>
+#include "AStarSearch.h"
+
+template <class AStarState>
+class FrontierSearch {
+
+public:
+
+    enum {
+        SEARCH_STATE_SEARCHING,
+        SEARCH_STATE_SUCCEEDED,
+        SEARCH_STATE_FAILED,
+        SEARCH_STATE_OUT_OF_MEMORY
+    };
+
+    static const size_t RECORD_SIZE = 2 * AStarState::PACKED_SIZE;
+
+    FrontierSearch();
+
+    void setStartAndGoalStates(AStarState &startState, AStarState &goalState);
+
+    void setUpperBound(int upperBound);
+
+    unsigned int searchStep();
+
+    bool getSolution(vector<AStarState> &path);
+
+    unsigned long getStepCount();
+
+    size_t getPeakStoredStates();
+
+private:
+
+    enum {
+        LAYER_EXPANDED,
+        LAYER_FOUND,
+        LAYER_EMPTY,
+        LAYER_OUT_OF_MEMORY
+    };
+
+    typedef integral_constant<bool, AStarStateHasBaseEstimate<AStarState>::value> HasBaseEstimate;
+
+    class Layers {
+
+    public:
+
+        AStarState goal;
+        int bound;
+        int relayDepth;
+        int depth;
+        int prunedBound;
+
+        vector<unsigned char> previous;
+        vector<unsigned char> current;
+        vector<unsigned char> next;
+    };
+
+    AStarSearch<AStarState> expander;
+    vector<AStarState> successors;
+    vector<unsigned int> order;
+    vector<unsigned char> sorted;
+
+    AStarState startState;
+    AStarState goalState;
+    Layers layers;
+    int upperBound;
+
+    unsigned int state;
+    unsigned long steps;
+    size_t peakStoredStates;
+
+    vector<AStarState> solution;
+
+    int heuristic(AStarState &aStarState, AStarState &goal, true_type);
+    int heuristic(AStarState &aStarState, AStarState &goal, false_type);
+
+    void startLayers(Layers &search, AStarState &from, AStarState &to, int bound, int relayDepth);
+
+    int expandLayer(Layers &search, unsigned char *goalRecord);
+
+    void sortLayer(Layers &search);
+
+    bool solve(AStarState &from, AStarState &to, int distance);
+
+    static bool containsState(const vector<unsigned char> &layer, const unsigned char *record);
+};
+
+template <class AStarState>
+const size_t FrontierSearch<AStarState>::RECORD_SIZE;
+
+template <class AStarState>
+FrontierSearch<AStarState>::FrontierSearch() {
+    upperBound = -1;
+    state = SEARCH_STATE_FAILED;
+    steps = 0;
+    peakStoredStates = 0;
+}
+
+template <class AStarState>
+void FrontierSearch<AStarState>::setStartAndGoalStates(AStarState &startState, AStarState &goalState) {
+    this->startState = startState;
+    this->goalState = goalState;
+    steps = 0;
+    peakStoredStates = 0;
+    solution.clear();
+    int bound = upperBound >= 0 ? upperBound : heuristic(startState, goalState, HasBaseEstimate());
+    startLayers(layers, startState, goalState, bound, max(bound / 2, 1));
+    state = SEARCH_STATE_SEARCHING;
+}
+
+template <class AStarState>
+void FrontierSearch<AStarState>::setUpperBound(int upperBound) {
+    this->upperBound = upperBound;
+}
+
+template <class AStarState>
+unsigned int FrontierSearch<AStarState>::searchStep() {
+    if (state != SEARCH_STATE_SEARCHING) return state;
+    unsigned char goalRecord[RECORD_SIZE];
+    int result = expandLayer(layers, goalRecord);
+    if (result == LAYER_EXPANDED) return state;
+    if (result == LAYER_OUT_OF_MEMORY) {
+        state = SEARCH_STATE_OUT_OF_MEMORY;
+    } else if (result == LAYER_EMPTY) {
+        // Nothing within the bound reaches the goal: a given bound is final, otherwise the next pass may go as far
+        // as the cheapest state this one pruned.
+        if (upperBound >= 0 || layers.prunedBound == INT_MAX) {
+            state = SEARCH_STATE_FAILED;
+        } else {
+            int bound = layers.prunedBound;
+            startLayers(layers, startState, goalState, bound, max(bound / 2, 1));
+        }
+    } else if (layers.depth > 1 && layers.depth < layers.relayDepth) {
+        // Found before the relay layer, so there is no midpoint: search again with the length now known.
+        startLayers(layers, startState, goalState, layers.depth, layers.depth / 2);
+    } else {
+        int distance = layers.depth;
+        int relayDepth = layers.relayDepth;
+        layers = Layers();
+        solution.assign(1, startState);
+        if (distance == 1) {
+            solution.push_back(goalState);
+        } else if (distance > 1) {
+            AStarState relay;
+            relay.unpack(goalRecord + AStarState::PACKED_SIZE);
+            if (!solve(startState, relay, relayDepth) || !solve(relay, goalState, distance - relayDepth)) {
+                solution.clear();
+            }
+        }
+        state = solution.empty() ? SEARCH_STATE_FAILED : SEARCH_STATE_SUCCEEDED;
+    }
+    return state;
+}
+
+template <class AStarState>
+bool FrontierSearch<AStarState>::getSolution(vector<AStarState> &path) {
+    if (state != SEARCH_STATE_SUCCEEDED) return false;
+    path = solution;
+    return true;
+}
+
+template <class AStarState>
+unsigned long FrontierSearch<AStarState>::getStepCount() {
+    return steps;
+}
+
+template <class AStarState>
+size_t FrontierSearch<AStarState>::getPeakStoredStates() {
+    return peakStoredStates;
+}
+
+template <class AStarState>
+int FrontierSearch<AStarState>::heuristic(AStarState &aStarState, AStarState &goal, true_type) {
+    return (int) aStarState.baseDistanceEstimate(goal);
+}
+
+template <class AStarState>
+int FrontierSearch<AStarState>::heuristic(AStarState &aStarState, AStarState &goal, false_type) {
+    return (int) aStarState.goalDistanceEstimate(goal);
+}
+
+template <class AStarState>
+void FrontierSearch<AStarState>::startLayers(Layers &search, AStarState &from, AStarState &to, int bound,
+                                             int relayDepth) {
+    search.goal = to;
+    search.bound = bound;
+    search.relayDepth = relayDepth;
+    search.depth = 0;
+    search.prunedBound = INT_MAX;
+    search.previous.clear();
+    search.next.clear();
+    search.current.resize(RECORD_SIZE);
+    from.pack(&search.current[0]);
+    from.pack(&search.current[AStarState::PACKED_SIZE]);
+}
+
+template <class AStarState>
+int FrontierSearch<AStarState>::expandLayer(Layers &search, unsigned char *goalRecord) {
+    size_t count = search.current.size() / RECORD_SIZE;
+    if (!count) return LAYER_EMPTY;
+    for (size_t i = 0; i < count; i++) {
+        AStarState aStarState;
+        aStarState.unpack(&search.current[i * RECORD_SIZE]);
+        if (aStarState.isGoal(search.goal)) {
+            memcpy(goalRecord, &search.current[i * RECORD_SIZE], RECORD_SIZE);
+            return LAYER_FOUND;
+        }
+    }
+    int depth = search.depth + 1;
+    search.next.clear();
+    try {
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char *record = &search.current[i * RECORD_SIZE];
+            AStarState aStarState;
+            aStarState.unpack(record);
+            if (!expander.expandState(aStarState, nullptr, successors)) return LAYER_OUT_OF_MEMORY;
+            steps++;
+            for (size_t j = 0; j < successors.size(); j++) {
+                int f = depth + heuristic(successors[j], search.goal, HasBaseEstimate());
+                if (f > search.bound) {
+                    search.prunedBound = min(search.prunedBound, f);
+                    continue;
+                }
+                size_t offset = search.next.size();
+                search.next.resize(offset + RECORD_SIZE);
+                successors[j].pack(&search.next[offset]);
+                // States in the relay layer are their own relay, deeper ones inherit it from their parent.
+                if (depth <= search.relayDepth) successors[j].pack(&search.next[offset + AStarState::PACKED_SIZE]);
+                else memcpy(&search.next[offset + AStarState::PACKED_SIZE], record + AStarState::PACKED_SIZE,
+                            AStarState::PACKED_SIZE);
+            }
+        }
+        sortLayer(search);
+    } catch (bad_alloc &) {
+        return LAYER_OUT_OF_MEMORY;
+    }
+    size_t stored = (search.previous.size() + search.current.size() + search.next.size()) / RECORD_SIZE;
+    peakStoredStates = max(peakStoredStates, stored);
+    search.previous.swap(search.current);
+    search.current.swap(search.next);
+    search.depth = depth;
+    return LAYER_EXPANDED;
+}
+
+template <class AStarState>
+void FrontierSearch<AStarState>::sortLayer(Layers &search) {
+    size_t count = search.next.size() / RECORD_SIZE;
+    order.resize(count);
+    for (size_t i = 0; i < count; i++) order[i] = (unsigned int) i;
+    const unsigned char *base = search.next.data();
+    sort(order.begin(), order.end(), [base](unsigned int x, unsigned int y) {
+        return memcmp(base + x * RECORD_SIZE, base + y * RECORD_SIZE, AStarState::PACKED_SIZE) < 0;
+    });
+    // Sorted, without the duplicates inside the layer and without the states of the two layers before it.
+    sorted.clear();
+    sorted.reserve(search.next.size());
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char *record = base + order[i] * RECORD_SIZE;
+        size_t last = sorted.size();
+        if (last && memcmp(&sorted[last - RECORD_SIZE], record, AStarState::PACKED_SIZE) == 0) continue;
+        if (containsState(search.current, record) || containsState(search.previous, record)) continue;
+        sorted.insert(sorted.end(), record, record + RECORD_SIZE);
+    }
+    search.next.swap(sorted);
+}
+
+template <class AStarState>
+bool FrontierSearch<AStarState>::solve(AStarState &from, AStarState &to, int distance) {
+    if (distance == 0) return true;
+    if (distance == 1) {
+        solution.push_back(to);
+        return true;
+    }
+    Layers search;
+    int relayDepth = distance / 2;
+    startLayers(search, from, to, distance, relayDepth);
+    unsigned char goalRecord[RECORD_SIZE];
+    int result;
+    do {
+        result = expandLayer(search, goalRecord);
+    } while (result == LAYER_EXPANDED);
+    if (result != LAYER_FOUND || search.depth != distance) return false;
+    AStarState relay;
+    relay.unpack(goalRecord + AStarState::PACKED_SIZE);
+    // The layers of this search are no longer needed by the halves below it.
+    search = Layers();
+    return solve(from, relay, relayDepth) && solve(relay, to, distance - relayDepth);
+}
+
+template <class AStarState>
+bool FrontierSearch<AStarState>::containsState(const vector<unsigned char> &layer, const unsigned char *record) {
+    size_t low = 0;
+    size_t high = layer.size() / RECORD_SIZE;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int comparison = memcmp(&layer[middle * RECORD_SIZE], record, AStarState::PACKED_SIZE);
+        if (comparison == 0) return true;
+        if (comparison < 0) low = middle + 1;
+        else high = middle;
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ * A fixed set of worker threads running tasks from a shared queue, in the order they were enqueued.
+ *
+ * The pool is sized once, so any number of tasks can be enqueued without starting more threads than the machine runs
+ * at once. Destroying the pool lets the workers finish every task already enqueued before they are joined.
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class ThreadPool {
+
+public:
+
+    explicit ThreadPool(unsigned int threadCount = thread::hardware_concurrency());
+
+    ~ThreadPool();
+
+    void enqueue(function<void()> task);
+
+    unsigned int getThreadCount();
+
+private:
+
+    vector<thread> threads;
+
+    queue<function<void()>> tasks;
+    mutex tasksMutex;
+    condition_variable tasksAvailable;
+    bool stopping;
+
+    void work();
+};
+
+inline ThreadPool::ThreadPool(unsigned int threadCount) {
+    stopping = false;
+    // hardware_concurrency() may not know, which it reports as zero.
+    threadCount = max(threadCount, 1u);
+    for (unsigned int i = 0; i < threadCount; i++) threads.push_back(thread(&ThreadPool::work, this));
+}
+
+inline ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+}
+
+inline void ThreadPool::enqueue(function<void()> task) {
+    {
+        lock_guard<mutex> lock(tasksMutex);
+        tasks.push(move(task));
+    }
+    tasksAvailable.notify_one();
+}
+
+inline unsigned int ThreadPool::getThreadCount() {
+    return (unsigned int) threads.size();
+}
+
+inline void ThreadPool::work() {
+    for ( ; ; ) {
+        function<void()> task;
+        {
+            unique_lock<mutex> lock(tasksMutex);
+            tasksAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * Benchmark of the batched heuristics against one goalDistanceEstimate() call per state, for grid cells with the
+ * Manhattan and octile distances and for 8 puzzle boards. Batches are as large as the successors of an expansion. The
+ * batch column includes filling the structure of arrays of each batch, as the search does while expanding, and the
+ * kernel column times the batched heuristic alone on batches filled beforehand.
+ *
+ * Build it with the vector extensions of the host to exercise the AVX2 path, otherwise both columns are scalar.
+ *
+ * Usage: ./HeuristicBenchmark.o
+ *
+ * @author Donato Meoli
+ */
+
+#include <chrono>
+#include <iomanip>
+#include "../find-path/MapSearchState.h"
+#include "../8-puzzle/PuzzleState.h"
+
+const int STATES = 1 << 16;
+const int ROUNDS = 64;
+
+template <class S>
+void benchmark(const char *name, vector<S> &states, S &goal, int batchSize) {
+    vector<typename S::Cost> scalar(states.size());
+    vector<typename S::Cost> batched(states.size());
+    typename S::EstimateBatch batch;
+    vector<typename S::EstimateBatch> filled((states.size() + batchSize - 1) / batchSize);
+    for (size_t i = 0; i < states.size(); i++) filled[i / batchSize].append(states[i]);
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < states.size(); i++) scalar[i] = states[i].goalDistanceEstimate(goal);
+    }
+    chrono::steady_clock::time_point middle = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < states.size(); i += batchSize) {
+            int count = (int) min((size_t) batchSize, states.size() - i);
+            batch.clear();
+            for (int state = 0; state < count; state++) batch.append(states[i + state]);
+            S::goalDistanceEstimateBatch(batch, goal, &batched[i]);
+        }
+    }
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t i = 0; i < filled.size(); i++) {
+            S::goalDistanceEstimateBatch(filled[i], goal, &batched[i * batchSize]);
+        }
+    }
+    chrono::steady_clock::time_point kernelEnd = chrono::steady_clock::now();
+    double scalarTime = chrono::duration<double, nano>(middle - begin).count() / (ROUNDS * states.size());
+    double batchTime = chrono::duration<double, nano>(end - middle).count() / (ROUNDS * states.size());
+    double kernelTime = chrono::duration<double, nano>(kernelEnd - end).count() / (ROUNDS * states.size());
+    cout << left << setw(10) << name << right << setw(6) << batchSize;
+    cout << fixed << setprecision(2) << setw(12) << scalarTime << setw(12) << batchTime << setw(12) << kernelTime;
+    cout << setw(10) << scalarTime / batchTime << "x" << (scalar == batched ? "" : "  MISMATCH") << endl;
+}
+
+int main(int argc, char *argv[]) {
+#ifdef __AVX2__
+    cout << "AVX2 enabled" << endl;
+#else
+    cout << "AVX2 disabled, scalar fallback" << endl;
+#endif
+    cout << left << setw(10) << "domain" << right << setw(6) << "batch";
+    cout << setw(12) << "scalar ns" << setw(12) << "batch ns" << setw(12) << "kernel ns";
+    cout << setw(11) << "speedup" << endl;
+    vector<MapSearchState> cells;
+    for (int i = 0; i < STATES; i++) {
+        cells.push_back(MapSearchState(rand() % MapSearchState::MAP_WIDTH, rand() % MapSearchState::MAP_HEIGHT));
+    }
+    MapSearchState goalCell(MapSearchState::MAP_WIDTH / 2, MapSearchState::MAP_HEIGHT / 2);
+    vector<PuzzleState> boards;
+    PuzzleState::TILE tiles[BOARD_WIDTH * BOARD_HEIGHT];
+    memcpy(tiles, PuzzleState::goal, sizeof(tiles));
+    for (int i = 0; i < STATES; i++) {
+        random_shuffle(tiles, tiles + BOARD_WIDTH * BOARD_HEIGHT);
+        boards.push_back(PuzzleState(tiles));
+    }
+    PuzzleState goalBoard(PuzzleState::goal);
+    int batchSizes[] = {3, 4, 8, 16};
+    for (int b = 0; b < 4; b++) {
+        MapSearchState::setDiagonalMovement(false);
+        benchmark("manhattan", cells, goalCell, batchSizes[b]);
+        MapSearchState::setDiagonalMovement(true);
+        benchmark("octile", cells, goalCell, batchSizes[b]);
+        benchmark("8-puzzle", boards, goalBoard, batchSizes[b]);
+    }
+    return EXIT_SUCCESS;
+}
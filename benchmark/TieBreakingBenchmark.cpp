@@ -0,0 +1,95 @@
+/**
+ * Benchmark of the tie-breaking policies of A* Search, counting the nodes expanded over the same random queries on the
+ * 8 puzzle, on the maze of FindPath and on an open grid where every cell costs the same, with and without diagonal
+ * moves. The user key column only applies to states that provide tieBreakKey().
+ *
+ * Usage: ./TieBreakingBenchmark.o
+ *
+ * @author Donato Meoli
+ */
+
+#include <iomanip>
+#include "../find-path/MapSearchState.h"
+#include "../8-puzzle/PuzzleState.h"
+
+const int QUERIES = 500;
+const int SCRAMBLE_MOVES = 60;
+
+const char *POLICY_NAMES[] = {"none", "higher g", "lifo", "user key"};
+
+template <class S>
+long expandedNodes(vector<S> &starts, vector<S> &goals, unsigned int tieBreaking) {
+    AStarSearch<S> aStarSearch;
+    aStarSearch.setTieBreaking(tieBreaking);
+    long expanded = 0;
+    for (size_t i = 0; i < starts.size(); i++) {
+        aStarSearch.setStartAndGoalStates(starts[i], goals[i]);
+        while (aStarSearch.searchStep() == AStarSearch<S>::SEARCH_STATE_SEARCHING) {
+        }
+        expanded += aStarSearch.getStepCount();
+        aStarSearch.freeSolutionNodes();
+    }
+    return expanded;
+}
+
+template <class S>
+void benchmark(const char *name, vector<S> &starts, vector<S> &goals) {
+    cout << left << setw(14) << name << right;
+    for (unsigned int policy = AStarSearch<S>::TIE_BREAKING_NONE; policy <= AStarSearch<S>::TIE_BREAKING_USER_KEY;
+         policy++) {
+        if (policy == AStarSearch<S>::TIE_BREAKING_USER_KEY && !AStarStateHasTieBreakKey<S>::value) {
+            cout << setw(12) << "-";
+        } else {
+            cout << setw(12) << expandedNodes(starts, goals, policy);
+        }
+    }
+    cout << endl;
+}
+
+void randomCells(vector<MapSearchState> &starts, vector<MapSearchState> &goals) {
+    starts.clear();
+    goals.clear();
+    for (int i = 0; i < 2 * QUERIES; i++) {
+        int x, y;
+        do {
+            x = rand() % MapSearchState::MAP_WIDTH;
+            y = rand() % MapSearchState::MAP_HEIGHT;
+        } while (MapSearchState::getMap(x, y) >= 9);
+        (i % 2 ? goals : starts).push_back(MapSearchState(x, y));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    cout << left << setw(14) << "domain" << right;
+    for (int policy = 0; policy < 4; policy++) cout << setw(12) << POLICY_NAMES[policy];
+    cout << endl;
+    // Boards scrambled from the goal by random moves, so every one is solvable.
+    vector<PuzzleState> boards;
+    vector<PuzzleState> boardGoals(QUERIES, PuzzleState(PuzzleState::goal));
+    AStarSearch<PuzzleState> expander;
+    vector<PuzzleState> moves;
+    for (int i = 0; i < QUERIES; i++) {
+        PuzzleState board(PuzzleState::goal);
+        for (int move = 0; move < SCRAMBLE_MOVES; move++) {
+            expander.expandState(board, nullptr, moves);
+            board = moves[rand() % moves.size()];
+        }
+        boards.push_back(board);
+    }
+    benchmark("8-puzzle", boards, boardGoals);
+    vector<MapSearchState> starts;
+    vector<MapSearchState> goals;
+    randomCells(starts, goals);
+    benchmark("maze", starts, goals);
+    MapSearchState::setDiagonalMovement(true);
+    benchmark("maze diagonal", starts, goals);
+    for (int y = 0; y < MapSearchState::MAP_HEIGHT; y++) {
+        for (int x = 0; x < MapSearchState::MAP_WIDTH; x++) MapSearchState::setMap(x, y, 1);
+    }
+    randomCells(starts, goals);
+    MapSearchState::setDiagonalMovement(false);
+    benchmark("open", starts, goals);
+    MapSearchState::setDiagonalMovement(true);
+    benchmark("open diagonal", starts, goals);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/**
+ * Goal-rooted distance fields over the world map of MapSearchState, for many agents heading to the same destinations.
+ *
+ * A field is computed once per goal by a reverse Dijkstra search from the goal and stores, for every cell, the cost of
+ * the cheapest path to the goal and the neighbour that path leaves through. The distance is a perfect heuristic for
+ * any search towards that goal, and following the neighbours walks an optimal path in O(path length) with no search
+ * at all. Moves are those of MapSearchState, diagonal ones included when they are enabled.
+ *
+ * Fields are kept in least recently used order within a memory budget, and all of them are dropped when the map
+ * version of MapSearchState shows that a cell or the movement rules changed since they were computed.
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef DISTANCE_FIELD_CACHE_H
+#define DISTANCE_FIELD_CACHE_H
+
+#include <climits>
+#include <list>
+#include <map>
+#include <queue>
+#include <limits>
+#include "MapSearchState.h"
+
+class DistanceFieldCache {
+
+public:
+
+    static const int CELL_COUNT = MapSearchState::MAP_WIDTH * MapSearchState::MAP_HEIGHT;
+    static const size_t FIELD_SIZE = CELL_COUNT * (sizeof(float) + sizeof(short));
+
+    static_assert(CELL_COUNT <= SHRT_MAX, "next cells are stored as short");
+
+    explicit DistanceFieldCache(size_t memoryLimit);
+
+    float getDistance(int x, int y, int goalX, int goalY);
+
+    bool getNextHop(int x, int y, int goalX, int goalY, int &nextX, int &nextY);
+
+    bool getPath(int startX, int startY, int goalX, int goalY, vector<MapSearchState> &path);
+
+    size_t getFieldCount();
+
+    unsigned int getFieldsComputed();
+
+private:
+
+    class DistanceField {
+
+    public:
+
+        int goal;
+
+        vector<float> distances;
+        vector<short> nextCells;
+    };
+
+    size_t memoryLimit;
+
+    list<DistanceField> fields;
+    map<int, list<DistanceField>::iterator> fieldsByGoal;
+
+    unsigned int mapVersion;
+    unsigned int fieldsComputed;
+
+    AStarSearch<MapSearchState> expander;
+    vector<MapSearchState> neighbours;
+
+    DistanceField *getField(int goalX, int goalY);
+
+    void computeField(DistanceField &field);
+};
+
+DistanceFieldCache::DistanceFieldCache(size_t memoryLimit) {
+    this->memoryLimit = memoryLimit;
+    mapVersion = MapSearchState::getMapVersion();
+    fieldsComputed = 0;
+}
+
+float DistanceFieldCache::getDistance(int x, int y, int goalX, int goalY) {
+    DistanceField *field = getField(goalX, goalY);
+    if (!field || x < 0 || x >= MapSearchState::MAP_WIDTH || y < 0 || y >= MapSearchState::MAP_HEIGHT) {
+        return numeric_limits<float>::max();
+    }
+    return field->distances[y * MapSearchState::MAP_WIDTH + x];
+}
+
+bool DistanceFieldCache::getNextHop(int x, int y, int goalX, int goalY, int &nextX, int &nextY) {
+    DistanceField *field = getField(goalX, goalY);
+    if (!field || x < 0 || x >= MapSearchState::MAP_WIDTH || y < 0 || y >= MapSearchState::MAP_HEIGHT) return false;
+    int next = field->nextCells[y * MapSearchState::MAP_WIDTH + x];
+    if (next < 0) return false;
+    nextX = next % MapSearchState::MAP_WIDTH;
+    nextY = next / MapSearchState::MAP_WIDTH;
+    return true;
+}
+
+bool DistanceFieldCache::getPath(int startX, int startY, int goalX, int goalY, vector<MapSearchState> &path) {
+    path.clear();
+    if (getDistance(startX, startY, goalX, goalY) == numeric_limits<float>::max()) return false;
+    int x = startX;
+    int y = startY;
+    path.push_back(MapSearchState(x, y));
+    while (x != goalX || y != goalY) {
+        if (!getNextHop(x, y, goalX, goalY, x, y)) return false;
+        path.push_back(MapSearchState(x, y));
+    }
+    return true;
+}
+
+size_t DistanceFieldCache::getFieldCount() {
+    return fields.size();
+}
+
+unsigned int DistanceFieldCache::getFieldsComputed() {
+    return fieldsComputed;
+}
+
+DistanceFieldCache::DistanceField *DistanceFieldCache::getField(int goalX, int goalY) {
+    if (goalX < 0 || goalX >= MapSearchState::MAP_WIDTH || goalY < 0 || goalY >= MapSearchState::MAP_HEIGHT) {
+        return nullptr;
+    }
+    if (mapVersion != MapSearchState::getMapVersion()) {
+        fields.clear();
+        fieldsByGoal.clear();
+        mapVersion = MapSearchState::getMapVersion();
+    }
+    int goal = goalY * MapSearchState::MAP_WIDTH + goalX;
+    map<int, list<DistanceField>::iterator>::iterator it = fieldsByGoal.find(goal);
+    if (it != fieldsByGoal.end()) {
+        fields.splice(fields.begin(), fields, it->second);
+        return &fields.front();
+    }
+    // The most recently used field always stays, even when a single one is over the budget.
+    while (!fields.empty() && (fields.size() + 1) * FIELD_SIZE > memoryLimit) {
+        fieldsByGoal.erase(fields.back().goal);
+        fields.pop_back();
+    }
+    fields.push_front(DistanceField());
+    fields.front().goal = goal;
+    fieldsByGoal[goal] = fields.begin();
+    computeField(fields.front());
+    return &fields.front();
+}
+
+void DistanceFieldCache::computeField(DistanceField &field) {
+    field.distances.assign(CELL_COUNT, numeric_limits<float>::max());
+    field.nextCells.assign(CELL_COUNT, -1);
+    fieldsComputed++;
+    field.distances[field.goal] = 0.0f;
+    // Nothing moves onto a blocked goal.
+    if (MapSearchState::getMap(field.goal % MapSearchState::MAP_WIDTH, field.goal / MapSearchState::MAP_WIDTH) >= 9) {
+        return;
+    }
+    priority_queue<pair<float, int>, vector<pair<float, int> >, greater<pair<float, int> > > frontier;
+    frontier.push(make_pair(0.0f, field.goal));
+    while (!frontier.empty()) {
+        float distance = frontier.top().first;
+        int current = frontier.top().second;
+        frontier.pop();
+        if (distance > field.distances[current]) continue;
+        MapSearchState currentState(current % MapSearchState::MAP_WIDTH, current / MapSearchState::MAP_WIDTH);
+        // Moves between passable cells go both ways, so the cells a state moves to are also those that move to it.
+        expander.expandState(currentState, nullptr, neighbours);
+        for (size_t i = 0; i < neighbours.size(); i++) {
+            int neighbour = (int) neighbours[i].rank();
+            float next = distance + neighbours[i].getCost(currentState);
+            if (next < field.distances[neighbour]) {
+                field.distances[neighbour] = next;
+                field.nextCells[neighbour] = (short) current;
+                frontier.push(make_pair(next, neighbour));
+            }
+        }
+    }
+}
+
+#endif
@@ -1,17 +1,150 @@
 /**
  * A* Search implementation to find a path on a simple grid maze.
  *
- * Usage: ./FindPath.o
+ * Usage: ./FindPath.o [hpa|multi|diagonal|async|field|walled]
+ *
+ * Example: ./FindPath.o hpa
+ *
+ * With hpa the path is found by Hierarchical Path-Finding A* on 5x5 clusters and refined one segment at a time.
+ * With multi the paths from the start to several random stops are found in a single search.
+ * With diagonal the path may also move diagonally, as long as it does not cut a corner.
+ * With async several random queries run concurrently on a thread pool, with a deadline each, and some are cancelled.
+ * With field several agents reach the same goal by following its cached distance field, without searching.
+ * With walled the goal is walled off with setMap() after a first search, so the second one fails before expanding it.
  *
  * @author Donato Meoli
  */
 
+#include <cstring>
 #include "MapSearchState.h"
+#include "HierarchicalMap.h"
+#include "DistanceFieldCache.h"
+#include "../AsyncAStarSearch.h"
 
-int main(int argc, char *argv[]) {
+#define ASYNC_QUERIES 8
+#define FIELD_AGENTS 5
+
+void randomCell(int &x, int &y) {
+    MapSearchState mapSearchState;
+    do {
+        y = rand() % MapSearchState::MAP_HEIGHT;
+        x = rand() % MapSearchState::MAP_WIDTH;
+    } while (mapSearchState.getMap(x, y) >= 9);
+}
+
+int findHierarchicalPath(int startX, int startY, int goalX, int goalY) {
+    HierarchicalMap hierarchicalMap(MapSearchState::MAP_WIDTH, MapSearchState::MAP_HEIGHT, MapSearchState::worldMap, 5);
+    HierarchicalPath path;
+    if (hierarchicalMap.findPath(startX, startY, goalX, goalY, path)) {
+        cout << "Search found goal state..." << endl;
+        cout << "Abstract nodes: " << hierarchicalMap.getAbstractNodeCount() << endl;
+        cout << "Displaying solution:" << endl;
+        int steps = -1;
+        int x, y;
+        while (path.getNext(x, y)) {
+            MapSearchState(x, y).printNodeInfo();
+            steps++;
+        }
+        cout << "Solution step: " << steps << endl;
+        cout << "Solution cost: " << path.getCost() << endl;
+    } else {
+        cout << "Search terminated. Did not find goal state!" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+
+int findMultiGoalPaths(int startX, int startY) {
     AStarSearch<MapSearchState> aStarSearch;
-    MapSearchState startState(rand() % MapSearchState::MAP_HEIGHT, rand() % MapSearchState::MAP_HEIGHT);
-    MapSearchState goalState(rand() % MapSearchState::MAP_WIDTH, rand() % MapSearchState::MAP_HEIGHT);
+    MapSearchState startState(startX, startY);
+    vector<MapSearchState> goalStates;
+    for (int i = 0; i < 5; i++) {
+        int goalX, goalY;
+        randomCell(goalX, goalY);
+        goalStates.push_back(MapSearchState(goalX, goalY));
+    }
+    aStarSearch.setStartAndGoalStates(startState, goalStates);
+    unsigned int searchState;
+    do {
+        searchState = aStarSearch.searchStep();
+    } while (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_SEARCHING);
+    if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_SUCCEEDED) {
+        vector<MapSearchState> path;
+        for (unsigned int i = 0; i < aStarSearch.getGoalCount(); i++) {
+            cout << "Goal " << i << ":" << endl;
+            if (!aStarSearch.getGoalPath(i, path)) {
+                cout << "Did not find goal state!" << endl;
+                continue;
+            }
+            for (size_t p = 0; p < path.size(); p++) path[p].printNodeInfo();
+            cout << "Solution cost: " << aStarSearch.getGoalCost(i) << endl;
+        }
+        aStarSearch.freeSolutionNodes();
+    } else if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_FAILED) {
+        cout << "Search terminated. Did not find goal state!" << endl;
+    } else if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_OUT_OF_MEMORY) {
+        cout << "Search terminated. Out of memory!" << endl;
+    }
+    cout << "Search steps: " << aStarSearch.getStepCount() << endl;
+    return EXIT_SUCCESS;
+}
+
+int findAsyncPaths() {
+    typedef AsyncAStarSearch<MapSearchState> AsyncSearch;
+    AsyncSearch asyncSearch;
+    vector<future<AsyncSearch::SearchResult>> results;
+    for (int i = 0; i < ASYNC_QUERIES; i++) {
+        int startX, startY, goalX, goalY;
+        randomCell(startX, startY);
+        randomCell(goalX, goalY);
+        MapSearchState startState(startX, startY);
+        MapSearchState goalState(goalX, goalY);
+        AsyncSearch::SearchOptions options;
+        options.deadline = chrono::steady_clock::now() + chrono::milliseconds(100);
+        if (i % 4 == 3) options.cancellationToken.cancel();
+        results.push_back(asyncSearch.submit(startState, goalState, options));
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        AsyncSearch::SearchResult result = results[i].get();
+        cout << "Query " << i << ": ";
+        if (result.state == AsyncSearch::SEARCH_STATE_SUCCEEDED) {
+            cout << "solution step " << result.path.size() - 1;
+        } else if (result.state == AsyncSearch::SEARCH_STATE_FAILED) {
+            cout << "did not find goal state";
+        } else if (result.state == AsyncSearch::SEARCH_STATE_OUT_OF_MEMORY) {
+            cout << "out of memory";
+        } else if (result.state == AsyncSearch::SEARCH_STATE_CANCELLED) {
+            cout << "cancelled";
+        } else if (result.state == AsyncSearch::SEARCH_STATE_DEADLINE_EXCEEDED) {
+            cout << "deadline exceeded";
+        }
+        cout << ", search steps " << result.steps << endl;
+    }
+    cout << "Search instances: " << asyncSearch.getIdleSearchCount() << endl;
+    return EXIT_SUCCESS;
+}
+
+int followDistanceField(int goalX, int goalY) {
+    DistanceFieldCache distanceFieldCache(16 * DistanceFieldCache::FIELD_SIZE);
+    vector<MapSearchState> path;
+    for (int i = 0; i < FIELD_AGENTS; i++) {
+        int startX, startY;
+        randomCell(startX, startY);
+        cout << "Agent " << i << ": ";
+        if (distanceFieldCache.getPath(startX, startY, goalX, goalY, path)) {
+            cout << "solution step " << path.size() - 1;
+            cout << ", solution cost " << distanceFieldCache.getDistance(startX, startY, goalX, goalY) << endl;
+        } else {
+            cout << "did not find goal state" << endl;
+        }
+    }
+    cout << "Distance fields computed: " << distanceFieldCache.getFieldsComputed() << endl;
+    return EXIT_SUCCESS;
+}
+
+int findPath(int startX, int startY, int goalX, int goalY) {
+    AStarSearch<MapSearchState> aStarSearch;
+    MapSearchState startState(startX, startY);
+    MapSearchState goalState(goalX, goalY);
     aStarSearch.setStartAndGoalStates(startState, goalState);
     unsigned int searchState;
     unsigned int searchSteps = 0;
@@ -21,18 +154,11 @@ int main(int argc, char *argv[]) {
     } while (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_SEARCHING);
     if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_SUCCEEDED) {
         cout << "Search found goal state..." << endl;
-        MapSearchState *mapSearchState = aStarSearch.getSolutionStart();
+        vector<MapSearchState> solution;
+        aStarSearch.getSolution(solution);
         cout << "Displaying solution:" << endl;
-        int steps = 0;
-        mapSearchState->printNodeInfo();
-        for ( ; ; ) {
-            mapSearchState = aStarSearch.getSolutionNext();
-            if (!mapSearchState) break;
-            mapSearchState->printNodeInfo();
-            steps++;
-        };
-        cout << "Solution step: " << steps << endl;
-        aStarSearch.freeSolutionNodes();
+        for (size_t i = 0; i < solution.size(); i++) solution[i].printNodeInfo();
+        cout << "Solution step: " << solution.size() - 1 << endl;
     } else if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_FAILED) {
         cout << "Search terminated. Did not find goal state!" << endl;
     } else if (searchState == AStarSearch<MapSearchState>::SEARCH_STATE_OUT_OF_MEMORY) {
@@ -42,3 +168,28 @@ int main(int argc, char *argv[]) {
     return EXIT_SUCCESS;
 }
 
+int findWalledOffPath(int startX, int startY, int goalX, int goalY) {
+    findPath(startX, startY, goalX, goalY);
+    // Blocking the four sides of the goal splits it from the rest of the map, which the connected components learn
+    // incrementally, so the search is refused before its first expansion.
+    MapSearchState::setMap(goalX - 1, goalY, 9);
+    MapSearchState::setMap(goalX + 1, goalY, 9);
+    MapSearchState::setMap(goalX, goalY - 1, 9);
+    MapSearchState::setMap(goalX, goalY + 1, 9);
+    cout << "Goal walled off..." << endl;
+    return findPath(startX, startY, goalX, goalY);
+}
+
+int main(int argc, char *argv[]) {
+    int startX, startY, goalX, goalY;
+    randomCell(startX, startY);
+    randomCell(goalX, goalY);
+    if (argc > 1 && strcmp(argv[1], "hpa") == 0) return findHierarchicalPath(startX, startY, goalX, goalY);
+    if (argc > 1 && strcmp(argv[1], "multi") == 0) return findMultiGoalPaths(startX, startY);
+    if (argc > 1 && strcmp(argv[1], "async") == 0) return findAsyncPaths();
+    if (argc > 1 && strcmp(argv[1], "field") == 0) return followDistanceField(goalX, goalY);
+    if (argc > 1 && strcmp(argv[1], "walled") == 0) return findWalledOffPath(startX, startY, goalX, goalY);
+    MapSearchState::setDiagonalMovement(argc > 1 && strcmp(argv[1], "diagonal") == 0);
+    return findPath(startX, startY, goalX, goalY);
+}
+
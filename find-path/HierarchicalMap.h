@@ -0,0 +1,621 @@
+/**
+ * Hierarchical Path-Finding A* (HPA*), by Botea, Müller and Schaeffer.
+ *
+ * The grid is split into square clusters. Along every border between two adjacent clusters the maximal runs of
+ * passable cell pairs become entrances, whose cells are the nodes of a small abstract graph. Nodes of the same cluster
+ * are linked by intra-cluster edges weighted with their distance inside the cluster, nodes of adjacent clusters by a
+ * single-step inter-cluster edge. A query searches the abstract graph and refines the abstract path into grid cells
+ * one segment at a time, so the first moves are available as soon as the abstract search ends.
+ *
+ * Editing a cell only invalidates its cluster: entrances and distances are rebuilt for that cluster and its neighbours
+ * the next time a path is requested.
+ *
+ * @author Donato Meoli
+ */
+
+#ifndef HIERARCHICAL_MAP_H
+#define HIERARCHICAL_MAP_H
+
+#include <map>
+#include <queue>
+#include <limits>
+#include <cstdlib>
+#include "../AStarSearch.h"
+#include "../AStarState.h"
+
+class HierarchicalMap;
+
+class AbstractSearchState : public AStarState<AbstractSearchState> {
+
+public:
+
+    const HierarchicalMap *hierarchicalMap;
+
+    int cell;
+
+    AbstractSearchState();
+
+    AbstractSearchState(const HierarchicalMap *hierarchicalMap, int cell);
+
+    float goalDistanceEstimate(AbstractSearchState &nodeGoal) override;
+
+    bool isGoal(AbstractSearchState &nodeGoal) override;
+
+    bool getSuccessors(SuccessorSink<AbstractSearchState> *successorSink, AbstractSearchState *parentNode) override;
+
+    float getCost(AbstractSearchState &successor) override;
+
+    bool isSameState(AbstractSearchState &rhs) override;
+
+    unsigned int rank();
+
+    unsigned int rankBound();
+};
+
+class ClusterSearchState : public AStarState<ClusterSearchState> {
+
+public:
+
+    const HierarchicalMap *hierarchicalMap;
+
+    int x;
+    int y;
+
+    ClusterSearchState();
+
+    ClusterSearchState(const HierarchicalMap *hierarchicalMap, int x, int y);
+
+    float goalDistanceEstimate(ClusterSearchState &nodeGoal) override;
+
+    bool isGoal(ClusterSearchState &nodeGoal) override;
+
+    bool getSuccessors(SuccessorSink<ClusterSearchState> *successorSink, ClusterSearchState *parentNode) override;
+
+    float getCost(ClusterSearchState &successor) override;
+
+    bool isSameState(ClusterSearchState &rhs) override;
+
+    unsigned int rank();
+
+    unsigned int rankBound();
+};
+
+class HierarchicalPath {
+
+public:
+
+    HierarchicalPath();
+
+    bool getNext(int &x, int &y);
+
+    float getCost();
+
+    size_t getWaypointCount();
+
+private:
+
+    friend class HierarchicalMap;
+
+    HierarchicalMap *hierarchicalMap;
+
+    vector<int> waypoints;
+    vector<int> segment;
+
+    size_t nextWaypoint;
+    size_t nextCell;
+
+    float cost;
+
+    bool refineNextSegment();
+};
+
+class HierarchicalMap {
+
+public:
+
+    static const int BLOCKED = 9;
+    static const int ENTRANCE_SPLIT = 6;
+
+    HierarchicalMap(int width, int height, const int *cells, int clusterSize);
+
+    int getMap(int x, int y) const;
+
+    void setMap(int x, int y, int value);
+
+    int getClusterOf(int x, int y) const;
+
+    bool findPath(int startX, int startY, int goalX, int goalY, HierarchicalPath &path);
+
+    size_t getAbstractNodeCount();
+
+private:
+
+    friend class AbstractSearchState;
+    friend class ClusterSearchState;
+    friend class HierarchicalPath;
+
+    struct Edge {
+        int cell;
+        float cost;
+    };
+
+    struct AbstractNode {
+        int cluster;
+        vector<Edge> interEdges;
+        vector<Edge> intraEdges;
+    };
+
+    int width;
+    int height;
+    int clusterSize;
+    int clustersX;
+    int clustersY;
+
+    vector<int> cells;
+
+    map<int, AbstractNode> nodes;
+    vector<vector<int> > clusterNodes;
+    vector<bool> dirtyClusters;
+
+    bool dirty;
+
+    // Kept across queries, so their map-sized rank tables are allocated once and cleared by a generation increment.
+    AStarSearch<AbstractSearchState> abstractSearch;
+    AStarSearch<ClusterSearchState> clusterSearch;
+
+    bool isPassable(int x, int y) const;
+
+    void getNeighbourClusters(int cluster, vector<int> &neighbours) const;
+
+    void rebuild();
+
+    void removeClusterNodes(int cluster);
+
+    void buildBorder(int clusterA, int clusterB);
+
+    void addEntrance(int cellA, int cellB);
+
+    void buildIntraEdges(int cluster);
+
+    void clusterDistances(int cell, bool reverse, vector<float> &distances) const;
+
+    bool insertNode(int cell);
+
+    void removeNode(int cell);
+
+    bool refineSegment(int fromCell, int toCell, vector<int> &segment);
+};
+
+AbstractSearchState::AbstractSearchState() {
+    hierarchicalMap = nullptr;
+    cell = 0;
+}
+
+AbstractSearchState::AbstractSearchState(const HierarchicalMap *hierarchicalMap, int cell) {
+    this->hierarchicalMap = hierarchicalMap;
+    this->cell = cell;
+}
+
+float AbstractSearchState::goalDistanceEstimate(AbstractSearchState &nodeGoal) {
+    int width = hierarchicalMap->width;
+    return (float) (abs(cell % width - nodeGoal.cell % width) + abs(cell / width - nodeGoal.cell / width));
+}
+
+bool AbstractSearchState::isGoal(AbstractSearchState &nodeGoal) {
+    return cell == nodeGoal.cell;
+}
+
+bool AbstractSearchState::getSuccessors(SuccessorSink<AbstractSearchState> *successorSink,
+                                        AbstractSearchState *parentNode) {
+    const HierarchicalMap::AbstractNode &node = hierarchicalMap->nodes.find(cell)->second;
+    for (size_t i = 0; i < node.interEdges.size(); i++) {
+        if (parentNode && parentNode->cell == node.interEdges[i].cell) continue;
+        if (!successorSink->emplaceSuccessor(hierarchicalMap, node.interEdges[i].cell)) return false;
+    }
+    for (size_t i = 0; i < node.intraEdges.size(); i++) {
+        if (parentNode && parentNode->cell == node.intraEdges[i].cell) continue;
+        if (!successorSink->emplaceSuccessor(hierarchicalMap, node.intraEdges[i].cell)) return false;
+    }
+    return true;
+}
+
+float AbstractSearchState::getCost(AbstractSearchState &successor) {
+    const HierarchicalMap::AbstractNode &node = hierarchicalMap->nodes.find(cell)->second;
+    float cost = numeric_limits<float>::max();
+    for (size_t i = 0; i < node.interEdges.size(); i++) {
+        if (node.interEdges[i].cell == successor.cell) cost = min(cost, node.interEdges[i].cost);
+    }
+    for (size_t i = 0; i < node.intraEdges.size(); i++) {
+        if (node.intraEdges[i].cell == successor.cell) cost = min(cost, node.intraEdges[i].cost);
+    }
+    return cost;
+}
+
+bool AbstractSearchState::isSameState(AbstractSearchState &rhs) {
+    return cell == rhs.cell;
+}
+
+unsigned int AbstractSearchState::rank() {
+    return cell;
+}
+
+unsigned int AbstractSearchState::rankBound() {
+    return hierarchicalMap->width * hierarchicalMap->height;
+}
+
+ClusterSearchState::ClusterSearchState() {
+    hierarchicalMap = nullptr;
+    x = 0;
+    y = 0;
+}
+
+ClusterSearchState::ClusterSearchState(const HierarchicalMap *hierarchicalMap, int x, int y) {
+    this->hierarchicalMap = hierarchicalMap;
+    this->x = x;
+    this->y = y;
+}
+
+float ClusterSearchState::goalDistanceEstimate(ClusterSearchState &nodeGoal) {
+    return (float) (abs(x - nodeGoal.x) + abs(y - nodeGoal.y));
+}
+
+bool ClusterSearchState::isGoal(ClusterSearchState &nodeGoal) {
+    return x == nodeGoal.x && y == nodeGoal.y;
+}
+
+bool ClusterSearchState::getSuccessors(SuccessorSink<ClusterSearchState> *successorSink,
+                                       ClusterSearchState *parentNode) {
+    static const int dx[] = {-1, 0, 1, 0};
+    static const int dy[] = {0, -1, 0, 1};
+    int cluster = hierarchicalMap->getClusterOf(x, y);
+    for (int i = 0; i < 4; i++) {
+        int nx = x + dx[i];
+        int ny = y + dy[i];
+        if (!hierarchicalMap->isPassable(nx, ny) || hierarchicalMap->getClusterOf(nx, ny) != cluster) continue;
+        if (parentNode && parentNode->x == nx && parentNode->y == ny) continue;
+        if (!successorSink->emplaceSuccessor(hierarchicalMap, nx, ny)) return false;
+    }
+    return true;
+}
+
+float ClusterSearchState::getCost(ClusterSearchState &successor) {
+    return (float) hierarchicalMap->getMap(x, y);
+}
+
+bool ClusterSearchState::isSameState(ClusterSearchState &rhs) {
+    return x == rhs.x && y == rhs.y;
+}
+
+unsigned int ClusterSearchState::rank() {
+    return (y * hierarchicalMap->width) + x;
+}
+
+unsigned int ClusterSearchState::rankBound() {
+    return hierarchicalMap->width * hierarchicalMap->height;
+}
+
+HierarchicalPath::HierarchicalPath() {
+    hierarchicalMap = nullptr;
+    nextWaypoint = 0;
+    nextCell = 0;
+    cost = 0.0f;
+}
+
+bool HierarchicalPath::getNext(int &x, int &y) {
+    if (!hierarchicalMap) return false;
+    if (nextCell == segment.size() && !refineNextSegment()) return false;
+    int cell = segment[nextCell++];
+    x = cell % hierarchicalMap->width;
+    y = cell / hierarchicalMap->width;
+    return true;
+}
+
+float HierarchicalPath::getCost() {
+    return cost;
+}
+
+size_t HierarchicalPath::getWaypointCount() {
+    return waypoints.size();
+}
+
+bool HierarchicalPath::refineNextSegment() {
+    segment.clear();
+    nextCell = 0;
+    if (nextWaypoint >= waypoints.size()) return false;
+    if (nextWaypoint == 0) {
+        segment.push_back(waypoints[nextWaypoint++]);
+        return true;
+    }
+    int fromCell = waypoints[nextWaypoint - 1];
+    int toCell = waypoints[nextWaypoint++];
+    return hierarchicalMap->refineSegment(fromCell, toCell, segment) && !segment.empty();
+}
+
+HierarchicalMap::HierarchicalMap(int width, int height, const int *cells, int clusterSize) {
+    this->width = width;
+    this->height = height;
+    this->clusterSize = clusterSize;
+    this->cells.assign(cells, cells + width * height);
+    clustersX = (width + clusterSize - 1) / clusterSize;
+    clustersY = (height + clusterSize - 1) / clusterSize;
+    clusterNodes.resize(clustersX * clustersY);
+    dirtyClusters.assign(clustersX * clustersY, true);
+    dirty = true;
+}
+
+int HierarchicalMap::getMap(int x, int y) const {
+    if (x < 0 || x >= width || y < 0 || y >= height) return BLOCKED;
+    return cells[(y * width) + x];
+}
+
+void HierarchicalMap::setMap(int x, int y, int value) {
+    if (x < 0 || x >= width || y < 0 || y >= height) return;
+    if (cells[(y * width) + x] == value) return;
+    cells[(y * width) + x] = value;
+    dirtyClusters[getClusterOf(x, y)] = true;
+    dirty = true;
+}
+
+int HierarchicalMap::getClusterOf(int x, int y) const {
+    return (y / clusterSize) * clustersX + (x / clusterSize);
+}
+
+bool HierarchicalMap::findPath(int startX, int startY, int goalX, int goalY, HierarchicalPath &path) {
+    path = HierarchicalPath();
+    if (!isPassable(startX, startY) || !isPassable(goalX, goalY)) return false;
+    if (dirty) rebuild();
+    int startCell = (startY * width) + startX;
+    int goalCell = (goalY * width) + goalX;
+    bool startInserted = insertNode(startCell);
+    bool goalInserted = insertNode(goalCell);
+    AbstractSearchState startState(this, startCell);
+    AbstractSearchState goalState(this, goalCell);
+    abstractSearch.setStartAndGoalStates(startState, goalState);
+    unsigned int searchState;
+    do {
+        searchState = abstractSearch.searchStep();
+    } while (searchState == AStarSearch<AbstractSearchState>::SEARCH_STATE_SEARCHING);
+    vector<AbstractSearchState> solution;
+    if (abstractSearch.getSolution(solution)) {
+        for (size_t i = 0; i < solution.size(); i++) {
+            if (i > 0) path.cost += solution[i - 1].getCost(solution[i]);
+            path.waypoints.push_back(solution[i].cell);
+        }
+        path.hierarchicalMap = this;
+    }
+    if (goalInserted) removeNode(goalCell);
+    if (startInserted) removeNode(startCell);
+    return path.hierarchicalMap != nullptr;
+}
+
+size_t HierarchicalMap::getAbstractNodeCount() {
+    if (dirty) rebuild();
+    return nodes.size();
+}
+
+bool HierarchicalMap::isPassable(int x, int y) const {
+    return getMap(x, y) < BLOCKED;
+}
+
+void HierarchicalMap::getNeighbourClusters(int cluster, vector<int> &neighbours) const {
+    int cx = cluster % clustersX;
+    int cy = cluster / clustersX;
+    neighbours.clear();
+    if (cx > 0) neighbours.push_back(cluster - 1);
+    if (cx < clustersX - 1) neighbours.push_back(cluster + 1);
+    if (cy > 0) neighbours.push_back(cluster - clustersX);
+    if (cy < clustersY - 1) neighbours.push_back(cluster + clustersX);
+}
+
+void HierarchicalMap::rebuild() {
+    int clusterCount = clustersX * clustersY;
+    vector<bool> affectedClusters(clusterCount, false);
+    vector<int> neighbours;
+    for (int c = 0; c < clusterCount; c++) {
+        if (dirtyClusters[c]) removeClusterNodes(c);
+    }
+    for (int c = 0; c < clusterCount; c++) {
+        if (!dirtyClusters[c]) continue;
+        affectedClusters[c] = true;
+        getNeighbourClusters(c, neighbours);
+        for (size_t i = 0; i < neighbours.size(); i++) {
+            affectedClusters[neighbours[i]] = true;
+            if (!dirtyClusters[neighbours[i]] || c < neighbours[i]) buildBorder(c, neighbours[i]);
+        }
+    }
+    for (int c = 0; c < clusterCount; c++) {
+        if (affectedClusters[c]) buildIntraEdges(c);
+    }
+    dirtyClusters.assign(clusterCount, false);
+    dirty = false;
+}
+
+void HierarchicalMap::removeClusterNodes(int cluster) {
+    vector<int> &members = clusterNodes[cluster];
+    for (size_t i = 0; i < members.size(); i++) {
+        AbstractNode &node = nodes[members[i]];
+        for (size_t j = 0; j < node.interEdges.size(); j++) {
+            int neighbourCell = node.interEdges[j].cell;
+            map<int, AbstractNode>::iterator iterNeighbour = nodes.find(neighbourCell);
+            if (iterNeighbour == nodes.end()) continue;
+            AbstractNode &neighbour = iterNeighbour->second;
+            vector<Edge> &edges = neighbour.interEdges;
+            for (size_t k = 0; k < edges.size(); ) {
+                if (edges[k].cell == members[i]) {
+                    edges.erase(edges.begin() + k);
+                } else {
+                    k++;
+                }
+            }
+            if (edges.empty()) {
+                vector<int> &neighbourMembers = clusterNodes[neighbour.cluster];
+                neighbourMembers.erase(find(neighbourMembers.begin(), neighbourMembers.end(), neighbourCell));
+                nodes.erase(neighbourCell);
+            }
+        }
+        nodes.erase(members[i]);
+    }
+    members.clear();
+}
+
+void HierarchicalMap::buildBorder(int clusterA, int clusterB) {
+    if (clusterA > clusterB) swap(clusterA, clusterB);
+    int ax = (clusterA % clustersX) * clusterSize;
+    int ay = (clusterA / clustersX) * clusterSize;
+    bool vertical = clusterB == clusterA + 1;
+    int length = vertical ? min(clusterSize, height - ay) : min(clusterSize, width - ax);
+    int runStart = -1;
+    for (int i = 0; i <= length; i++) {
+        int xa = vertical ? ax + clusterSize - 1 : ax + i;
+        int ya = vertical ? ay + i : ay + clusterSize - 1;
+        int xb = vertical ? xa + 1 : xa;
+        int yb = vertical ? ya : ya + 1;
+        bool open = i < length && isPassable(xa, ya) && isPassable(xb, yb);
+        if (open && runStart < 0) {
+            runStart = i;
+        } else if (!open && runStart >= 0) {
+            int runEnd = i - 1;
+            int entrances[2] = {(runStart + runEnd) / 2, -1};
+            if (i - runStart >= ENTRANCE_SPLIT) {
+                entrances[0] = runStart;
+                entrances[1] = runEnd;
+            }
+            for (int e = 0; e < 2 && entrances[e] >= 0; e++) {
+                int cellA = vertical ? (ay + entrances[e]) * width + xa : ya * width + ax + entrances[e];
+                int cellB = vertical ? cellA + 1 : cellA + width;
+                addEntrance(cellA, cellB);
+            }
+            runStart = -1;
+        }
+    }
+}
+
+void HierarchicalMap::addEntrance(int cellA, int cellB) {
+    int ends[2] = {cellA, cellB};
+    for (int i = 0; i < 2; i++) {
+        if (nodes.find(ends[i]) == nodes.end()) {
+            AbstractNode &node = nodes[ends[i]];
+            node.cluster = getClusterOf(ends[i] % width, ends[i] / width);
+            clusterNodes[node.cluster].push_back(ends[i]);
+        }
+    }
+    Edge edgeAB = {cellB, (float) cells[cellA]};
+    Edge edgeBA = {cellA, (float) cells[cellB]};
+    nodes[cellA].interEdges.push_back(edgeAB);
+    nodes[cellB].interEdges.push_back(edgeBA);
+}
+
+void HierarchicalMap::buildIntraEdges(int cluster) {
+    vector<int> &members = clusterNodes[cluster];
+    vector<float> distances;
+    int originX = (cluster % clustersX) * clusterSize;
+    int originY = (cluster / clustersX) * clusterSize;
+    for (size_t i = 0; i < members.size(); i++) {
+        AbstractNode &node = nodes[members[i]];
+        node.intraEdges.clear();
+        clusterDistances(members[i], false, distances);
+        for (size_t j = 0; j < members.size(); j++) {
+            if (i == j) continue;
+            int local = (members[j] / width - originY) * clusterSize + (members[j] % width - originX);
+            if (distances[local] == numeric_limits<float>::max()) continue;
+            Edge edge = {members[j], distances[local]};
+            node.intraEdges.push_back(edge);
+        }
+    }
+}
+
+void HierarchicalMap::clusterDistances(int cell, bool reverse, vector<float> &distances) const {
+    static const int dx[] = {-1, 0, 1, 0};
+    static const int dy[] = {0, -1, 0, 1};
+    int cluster = getClusterOf(cell % width, cell / width);
+    int originX = (cluster % clustersX) * clusterSize;
+    int originY = (cluster / clustersX) * clusterSize;
+    distances.assign(clusterSize * clusterSize, numeric_limits<float>::max());
+    priority_queue<pair<float, int>, vector<pair<float, int> >, greater<pair<float, int> > > frontier;
+    distances[(cell / width - originY) * clusterSize + (cell % width - originX)] = 0.0f;
+    frontier.push(make_pair(0.0f, cell));
+    while (!frontier.empty()) {
+        float distance = frontier.top().first;
+        int current = frontier.top().second;
+        frontier.pop();
+        int x = current % width;
+        int y = current / width;
+        if (distance > distances[(y - originY) * clusterSize + (x - originX)]) continue;
+        for (int i = 0; i < 4; i++) {
+            int nx = x + dx[i];
+            int ny = y + dy[i];
+            if (!isPassable(nx, ny) || getClusterOf(nx, ny) != cluster) continue;
+            // Leaving a cell costs its own value, so walking backwards pays for the neighbour instead.
+            float next = distance + (float) (reverse ? getMap(nx, ny) : getMap(x, y));
+            float &best = distances[(ny - originY) * clusterSize + (nx - originX)];
+            if (next < best) {
+                best = next;
+                frontier.push(make_pair(next, ny * width + nx));
+            }
+        }
+    }
+}
+
+bool HierarchicalMap::insertNode(int cell) {
+    if (nodes.find(cell) != nodes.end()) return false;
+    int cluster = getClusterOf(cell % width, cell / width);
+    int originX = (cluster % clustersX) * clusterSize;
+    int originY = (cluster / clustersX) * clusterSize;
+    vector<int> &members = clusterNodes[cluster];
+    vector<float> forward;
+    vector<float> backward;
+    clusterDistances(cell, false, forward);
+    clusterDistances(cell, true, backward);
+    AbstractNode &node = nodes[cell];
+    node.cluster = cluster;
+    for (size_t i = 0; i < members.size(); i++) {
+        int local = (members[i] / width - originY) * clusterSize + (members[i] % width - originX);
+        if (forward[local] != numeric_limits<float>::max()) {
+            Edge edge = {members[i], forward[local]};
+            node.intraEdges.push_back(edge);
+        }
+        if (backward[local] != numeric_limits<float>::max()) {
+            Edge edge = {cell, backward[local]};
+            nodes[members[i]].intraEdges.push_back(edge);
+        }
+    }
+    members.push_back(cell);
+    return true;
+}
+
+void HierarchicalMap::removeNode(int cell) {
+    AbstractNode &node = nodes[cell];
+    vector<int> &members = clusterNodes[node.cluster];
+    members.erase(find(members.begin(), members.end(), cell));
+    for (size_t i = 0; i < members.size(); i++) {
+        vector<Edge> &edges = nodes[members[i]].intraEdges;
+        for (size_t k = 0; k < edges.size(); ) {
+            if (edges[k].cell == cell) {
+                edges.erase(edges.begin() + k);
+            } else {
+                k++;
+            }
+        }
+    }
+    nodes.erase(cell);
+}
+
+bool HierarchicalMap::refineSegment(int fromCell, int toCell, vector<int> &segment) {
+    if (getClusterOf(fromCell % width, fromCell / width) != getClusterOf(toCell % width, toCell / width)) {
+        segment.push_back(toCell);
+        return true;
+    }
+    ClusterSearchState startState(this, fromCell % width, fromCell / width);
+    ClusterSearchState goalState(this, toCell % width, toCell / width);
+    clusterSearch.setStartAndGoalStates(startState, goalState);
+    unsigned int searchState;
+    do {
+        searchState = clusterSearch.searchStep();
+    } while (searchState == AStarSearch<ClusterSearchState>::SEARCH_STATE_SEARCHING);
+    vector<ClusterSearchState> solution;
+    if (!clusterSearch.getSolution(solution)) return false;
+    for (size_t i = 1; i < solution.size(); i++) segment.push_back(solution[i].y * width + solution[i].x);
+    return true;
+}
+
+#endif
@@ -1,8 +1,15 @@
 #ifndef MAP_SEARCH_STATE_H
 #define MAP_SEARCH_STATE_H
 
+#include <atomic>
+#include <climits>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "../AStarSearch.h"
 #include "../AStarState.h"
 
@@ -13,30 +20,32 @@ public:
     static const int MAP_WIDTH = 20;
     static const int MAP_HEIGHT = 20;
 
-    int worldMap[MAP_WIDTH * MAP_HEIGHT] = {
-            1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,   // 00
-            1,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,1,   // 01
-            1,9,9,1,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 02
-            1,9,9,1,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 03
-            1,9,1,1,1,1,9,9,1,9,1,9,1,1,1,1,9,9,1,1,   // 04
-            1,9,1,1,9,1,1,1,1,9,1,1,1,1,9,1,1,1,1,1,   // 05
-            1,9,9,9,9,1,1,1,1,1,1,9,9,9,9,1,1,1,1,1,   // 06
-            1,9,9,9,9,9,9,9,9,1,1,1,9,9,9,9,9,9,9,1,   // 07
-            1,9,1,1,1,1,1,1,1,1,1,9,1,1,1,1,1,1,1,1,   // 08
-            1,9,1,9,9,9,9,9,9,9,1,1,9,9,9,9,9,9,9,1,   // 09
-            1,9,1,1,1,1,9,1,1,9,1,1,1,1,1,1,1,1,1,1,   // 10
-            1,9,9,9,9,9,1,9,1,9,1,9,9,9,9,9,1,1,1,1,   // 11
-            1,9,1,9,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 12
-            1,9,1,9,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 13
-            1,9,1,1,1,1,9,9,1,9,1,9,1,1,1,1,9,9,1,1,   // 14
-            1,9,1,1,9,1,1,1,1,9,1,1,1,1,9,1,1,1,1,1,   // 15
-            1,9,9,9,9,1,1,1,1,1,1,9,9,9,9,1,1,1,1,1,   // 16
-            1,1,9,9,9,9,9,9,9,1,1,1,9,9,9,1,9,9,9,9,   // 17
-            1,9,1,1,1,1,1,1,1,1,1,9,1,1,1,1,1,1,1,1,   // 18
-            1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1    // 19
+    static const int PADDED_WIDTH = MAP_WIDTH + 2;
+    static const int PADDED_HEIGHT = MAP_HEIGHT + 2;
+
+    static const int PACKED_SIZE = 4;
+
+    static int worldMap[MAP_WIDTH * MAP_HEIGHT];
+
+    class EstimateBatch {
+
+    public:
+
+        vector<int> xs;
+        vector<int> ys;
+
+        void clear();
+
+        void append(MapSearchState &state);
     };
 
-    int getMap(int x, int y);
+    static int getMap(int x, int y);
+
+    static void setMap(int x, int y, int value);
+
+    static void setDiagonalMovement(bool diagonalMovement);
+
+    static unsigned int getMapVersion();
 
     MapSearchState();
 
@@ -44,22 +53,118 @@ public:
 
     float goalDistanceEstimate(MapSearchState &nodeGoal) override;
 
+    static void goalDistanceEstimateBatch(EstimateBatch &batch, MapSearchState &nodeGoal, float *estimates);
+
+    static unsigned int minimumBatchSize();
+
     bool isGoal(MapSearchState &nodeGoal) override;
 
-    bool getSuccessors(AStarSearch<MapSearchState> *aStarSearch, MapSearchState *parentNode) override;
+    bool getSuccessors(SuccessorSink<MapSearchState> *successorSink, MapSearchState *parentNode) override;
 
     float getCost(MapSearchState &successor) override;
 
     bool isSameState(MapSearchState &rhs) override;
 
+    bool isReachable(MapSearchState &nodeGoal);
+
+    unsigned int rank();
+
+    unsigned int rankBound();
+
+    void pack(unsigned char *record);
+
+    void unpack(const unsigned char *record);
+
     void printNodeInfo();
 
 private:
 
+    static const int DIRECTION_X[8];
+    static const int DIRECTION_Y[8];
+
+    static bool diagonalMovement;
+    static unsigned int mapVersion;
+    static atomic<bool> neighbourMasksDirty;
+    static mutex neighbourMasksMutex;
+
+    static unsigned char passableMap[PADDED_WIDTH * PADDED_HEIGHT];
+    static unsigned char neighbourMasks[MAP_WIDTH * MAP_HEIGHT];
+
+    static const int CELL_COUNT = MAP_WIDTH * MAP_HEIGHT;
+    static const int BLOCKED_COMPONENT = -1;
+    static const int UNLABELLED_COMPONENT = -2;
+
+    static atomic<bool> componentsDirty;
+    static mutex componentsMutex;
+
+    static int componentLabels[CELL_COUNT];
+    static int componentSizes[2 * CELL_COUNT];
+    static int nextComponentLabel;
+
+    static void buildNeighbourMasks(int minY, int maxY);
+
+    static void buildComponents();
+
+    static void updateComponents(int x, int y);
+
+    static int floodComponent(int cell, int oldLabel, int newLabel);
+
     int x;
     int y;
 };
 
+int MapSearchState::worldMap[] = {
+        1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,   // 00
+        1,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,1,   // 01
+        1,9,9,1,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 02
+        1,9,9,1,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 03
+        1,9,1,1,1,1,9,9,1,9,1,9,1,1,1,1,9,9,1,1,   // 04
+        1,9,1,1,9,1,1,1,1,9,1,1,1,1,9,1,1,1,1,1,   // 05
+        1,9,9,9,9,1,1,1,1,1,1,9,9,9,9,1,1,1,1,1,   // 06
+        1,9,9,9,9,9,9,9,9,1,1,1,9,9,9,9,9,9,9,1,   // 07
+        1,9,1,1,1,1,1,1,1,1,1,9,1,1,1,1,1,1,1,1,   // 08
+        1,9,1,9,9,9,9,9,9,9,1,1,9,9,9,9,9,9,9,1,   // 09
+        1,9,1,1,1,1,9,1,1,9,1,1,1,1,1,1,1,1,1,1,   // 10
+        1,9,9,9,9,9,1,9,1,9,1,9,9,9,9,9,1,1,1,1,   // 11
+        1,9,1,9,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 12
+        1,9,1,9,1,9,9,9,1,9,1,9,1,9,1,9,9,9,1,1,   // 13
+        1,9,1,1,1,1,9,9,1,9,1,9,1,1,1,1,9,9,1,1,   // 14
+        1,9,1,1,9,1,1,1,1,9,1,1,1,1,9,1,1,1,1,1,   // 15
+        1,9,9,9,9,1,1,1,1,1,1,9,9,9,9,1,1,1,1,1,   // 16
+        1,1,9,9,9,9,9,9,9,1,1,1,9,9,9,1,9,9,9,9,   // 17
+        1,9,1,1,1,1,1,1,1,1,1,9,1,1,1,1,1,1,1,1,   // 18
+        1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1    // 19
+};
+
+// W, N, E, S, then NW, NE, SE, SW: bit i of a neighbour mask allows the move in direction i.
+const int MapSearchState::DIRECTION_X[] = {-1, 0, 1, 0, -1, 1, 1, -1};
+const int MapSearchState::DIRECTION_Y[] = {0, -1, 0, 1, -1, -1, 1, 1};
+
+bool MapSearchState::diagonalMovement = false;
+unsigned int MapSearchState::mapVersion = 0;
+atomic<bool> MapSearchState::neighbourMasksDirty(true);
+mutex MapSearchState::neighbourMasksMutex;
+
+unsigned char MapSearchState::passableMap[];
+unsigned char MapSearchState::neighbourMasks[];
+
+atomic<bool> MapSearchState::componentsDirty(true);
+mutex MapSearchState::componentsMutex;
+
+int MapSearchState::componentLabels[];
+int MapSearchState::componentSizes[];
+int MapSearchState::nextComponentLabel = 0;
+
+void MapSearchState::EstimateBatch::clear() {
+    xs.clear();
+    ys.clear();
+}
+
+void MapSearchState::EstimateBatch::append(MapSearchState &state) {
+    xs.push_back(state.x);
+    ys.push_back(state.y);
+}
+
 MapSearchState::MapSearchState() {
     x = 0;
     y = 0;
@@ -71,7 +176,51 @@ MapSearchState::MapSearchState(int x, int y) {
 }
 
 float MapSearchState::goalDistanceEstimate(MapSearchState &nodeGoal) {
-    return fabsf(x - nodeGoal.x) + fabsf(y - nodeGoal.y);
+    float dx = fabsf(x - nodeGoal.x);
+    float dy = fabsf(y - nodeGoal.y);
+    // Octile distance: diagonal steps while both coordinates differ, straight steps for the rest.
+    if (diagonalMovement) return fmaxf(dx, dy) + ((float) M_SQRT2 - 1.0f) * fminf(dx, dy);
+    return dx + dy;
+}
+
+unsigned int MapSearchState::minimumBatchSize() {
+#ifdef __AVX2__
+    // The Manhattan distance is so cheap that filling a batch only pays off from about 16 states, more than a cell ever
+    // has successors, while the octile distance pays off from the smallest batch.
+    return diagonalMovement ? 1 : 16;
+#else
+    return UINT_MAX;
+#endif
+}
+
+void MapSearchState::goalDistanceEstimateBatch(EstimateBatch &batch, MapSearchState &nodeGoal, float *estimates) {
+    int count = (int) batch.xs.size();
+    const int *xs = batch.xs.data();
+    const int *ys = batch.ys.data();
+    int i = 0;
+#ifdef __AVX2__
+    // Eight states per iteration, loaded straight from the coordinate arrays. A partial batch masks off the lanes past
+    // the end, so an expansion with fewer than eight survivors still takes a single pass.
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i goalX = _mm256_set1_epi32(nodeGoal.x);
+    const __m256i goalY = _mm256_set1_epi32(nodeGoal.y);
+    const __m256 diagonalFactor = _mm256_set1_ps((float) M_SQRT2 - 1.0f);
+    for ( ; i < count; i += 8) {
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lanes);
+        __m256i x = _mm256_maskload_epi32(xs + i, mask);
+        __m256i y = _mm256_maskload_epi32(ys + i, mask);
+        __m256 dx = _mm256_cvtepi32_ps(_mm256_abs_epi32(_mm256_sub_epi32(x, goalX)));
+        __m256 dy = _mm256_cvtepi32_ps(_mm256_abs_epi32(_mm256_sub_epi32(y, goalY)));
+        __m256 h;
+        if (diagonalMovement) {
+            h = _mm256_add_ps(_mm256_max_ps(dx, dy), _mm256_mul_ps(diagonalFactor, _mm256_min_ps(dx, dy)));
+        } else {
+            h = _mm256_add_ps(dx, dy);
+        }
+        _mm256_maskstore_ps(estimates + i, mask, h);
+    }
+#endif
+    for ( ; i < count; i++) estimates[i] = MapSearchState(xs[i], ys[i]).goalDistanceEstimate(nodeGoal);
 }
 
 bool MapSearchState::isGoal(MapSearchState &nodeGoal) {
@@ -83,34 +232,174 @@ int MapSearchState::getMap(int x, int y) {
     return worldMap[(y * MAP_WIDTH) + x];
 }
 
-bool MapSearchState::getSuccessors(AStarSearch<MapSearchState> *aStarSearch, MapSearchState *parentNode) {
+void MapSearchState::setMap(int x, int y, int value) {
+    if (x < 0 || x >= MAP_WIDTH || y < 0 || y >= MAP_HEIGHT) return;
+    bool wasPassable = worldMap[(y * MAP_WIDTH) + x] < 9;
+    worldMap[(y * MAP_WIDTH) + x] = value;
+    mapVersion++;
+    if (!componentsDirty && wasPassable != (value < 9)) updateComponents(x, y);
+    if (neighbourMasksDirty) return;
+    passableMap[((y + 1) * PADDED_WIDTH) + x + 1] = value < 9;
+    buildNeighbourMasks(max(y - 1, 0), min(y + 1, MAP_HEIGHT - 1));
+}
+
+void MapSearchState::setDiagonalMovement(bool diagonalMovement) {
+    if (MapSearchState::diagonalMovement != diagonalMovement) mapVersion++;
+    MapSearchState::diagonalMovement = diagonalMovement;
+}
+
+unsigned int MapSearchState::getMapVersion() {
+    return mapVersion;
+}
+
+void MapSearchState::buildNeighbourMasks(int minY, int maxY) {
+    bool rebuild = neighbourMasksDirty;
+    if (rebuild) {
+        memset(passableMap, 0, sizeof(passableMap));
+        for (int y = 0; y < MAP_HEIGHT; y++) {
+            for (int x = 0; x < MAP_WIDTH; x++) {
+                passableMap[((y + 1) * PADDED_WIDTH) + x + 1] = worldMap[(y * MAP_WIDTH) + x] < 9;
+            }
+        }
+    }
+    // The blocked border of the padded map removes every bounds check, and each row is a straight run of byte
+    // operations over three padded rows that the compiler can vectorise. Diagonals need both sides free, so a move
+    // never cuts a corner.
+    for (int y = minY; y <= maxY; y++) {
+        const unsigned char *above = &passableMap[y * PADDED_WIDTH + 1];
+        const unsigned char *row = above + PADDED_WIDTH;
+        const unsigned char *below = row + PADDED_WIDTH;
+        unsigned char *masks = &neighbourMasks[y * MAP_WIDTH];
+        for (int x = 0; x < MAP_WIDTH; x++) {
+            unsigned char w = row[x - 1];
+            unsigned char n = above[x];
+            unsigned char e = row[x + 1];
+            unsigned char s = below[x];
+            unsigned char nw = above[x - 1] & n & w;
+            unsigned char ne = above[x + 1] & n & e;
+            unsigned char se = below[x + 1] & s & e;
+            unsigned char sw = below[x - 1] & s & w;
+            masks[x] = (unsigned char) (w | (n << 1) | (e << 2) | (s << 3) |
+                                        (nw << 4) | (ne << 5) | (se << 6) | (sw << 7));
+        }
+    }
+    // Cleared only once every mask is in place, so a search on another thread never reads a half-built table.
+    if (rebuild) neighbourMasksDirty = false;
+}
+
+void MapSearchState::buildComponents() {
+    for (int cell = 0; cell < CELL_COUNT; cell++) {
+        componentLabels[cell] = worldMap[cell] < 9 ? UNLABELLED_COMPONENT : BLOCKED_COMPONENT;
+    }
+    nextComponentLabel = 0;
+    for (int cell = 0; cell < CELL_COUNT; cell++) {
+        if (componentLabels[cell] != UNLABELLED_COMPONENT) continue;
+        componentSizes[nextComponentLabel] = floodComponent(cell, UNLABELLED_COMPONENT, nextComponentLabel);
+        nextComponentLabel++;
+    }
+    componentsDirty = false;
+}
+
+void MapSearchState::updateComponents(int x, int y) {
+    // Searches on other threads read the labels through isReachable(), so they only ever change under the lock.
+    lock_guard<mutex> lock(componentsMutex);
+    int cell = (y * MAP_WIDTH) + x;
+    // Diagonal moves need both sides free, so they never join cells the straight moves leave apart.
+    int neighbours[4];
+    int neighbourCount = 0;
+    for (int direction = 0; direction < 4; direction++) {
+        int nx = x + DIRECTION_X[direction];
+        int ny = y + DIRECTION_Y[direction];
+        if (getMap(nx, ny) < 9) neighbours[neighbourCount++] = (ny * MAP_WIDTH) + nx;
+    }
+    if (worldMap[cell] < 9) {
+        // An opened cell joins the components around it: the smaller ones are relabelled into the largest.
+        int label = -1;
+        for (int i = 0; i < neighbourCount; i++) {
+            int neighbourLabel = componentLabels[neighbours[i]];
+            if (label < 0 || componentSizes[neighbourLabel] > componentSizes[label]) label = neighbourLabel;
+        }
+        if (label < 0) {
+            if (nextComponentLabel == 2 * CELL_COUNT) {
+                buildComponents();
+                return;
+            }
+            label = nextComponentLabel++;
+            componentSizes[label] = 0;
+        }
+        for (int i = 0; i < neighbourCount; i++) {
+            int neighbourLabel = componentLabels[neighbours[i]];
+            if (neighbourLabel != label) componentSizes[label] += floodComponent(neighbours[i], neighbourLabel, label);
+        }
+        componentLabels[cell] = label;
+        componentSizes[label]++;
+    } else {
+        // A blocked cell may split its component, so each side left around it is flooded again under a new label.
+        componentSizes[componentLabels[cell]]--;
+        componentLabels[cell] = BLOCKED_COMPONENT;
+        int firstLabel = nextComponentLabel;
+        for (int i = 0; i < neighbourCount; i++) {
+            int neighbourLabel = componentLabels[neighbours[i]];
+            if (neighbourLabel >= firstLabel) continue;
+            if (nextComponentLabel == 2 * CELL_COUNT) {
+                buildComponents();
+                return;
+            }
+            componentSizes[neighbourLabel] = 0;
+            componentSizes[nextComponentLabel] = floodComponent(neighbours[i], neighbourLabel, nextComponentLabel);
+            nextComponentLabel++;
+        }
+    }
+}
+
+int MapSearchState::floodComponent(int cell, int oldLabel, int newLabel) {
+    vector<int> pending(1, cell);
+    componentLabels[cell] = newLabel;
+    int size = 0;
+    while (!pending.empty()) {
+        int current = pending.back();
+        pending.pop_back();
+        size++;
+        int cx = current % MAP_WIDTH;
+        int cy = current / MAP_WIDTH;
+        for (int direction = 0; direction < 4; direction++) {
+            int nx = cx + DIRECTION_X[direction];
+            int ny = cy + DIRECTION_Y[direction];
+            if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT) continue;
+            int neighbour = (ny * MAP_WIDTH) + nx;
+            if (componentLabels[neighbour] != oldLabel) continue;
+            componentLabels[neighbour] = newLabel;
+            pending.push_back(neighbour);
+        }
+    }
+    return size;
+}
+
+bool MapSearchState::getSuccessors(SuccessorSink<MapSearchState> *successorSink, MapSearchState *parentNode) {
+    if (neighbourMasksDirty) {
+        lock_guard<mutex> lock(neighbourMasksMutex);
+        if (neighbourMasksDirty) buildNeighbourMasks(0, MAP_HEIGHT - 1);
+    }
     int parentX = -1;
     int parentY = -1;
     if (parentNode) {
         parentX = parentNode->x;
         parentY = parentNode->y;
     }
-    MapSearchState mapSearchState;
-    if (getMap(x-1, y) < 9 && !(parentX == x-1 && parentY == y)) {
-        mapSearchState = MapSearchState(x-1, y);
-        aStarSearch->addSuccessor(mapSearchState);
-    }
-    if (getMap(x, y-1 < 9) && !(parentX == x && parentY == y-1)) {
-        mapSearchState = MapSearchState(x, y-1);
-        aStarSearch->addSuccessor(mapSearchState);
-    }
-    if (getMap(x+1, y) < 9 && !(parentX == x+1 && parentY == y)) {
-        mapSearchState = MapSearchState(x+1, y);
-        aStarSearch->addSuccessor(mapSearchState);
-    }
-    if (getMap(x, y+1) < 9 && !(parentX == x && parentY == y+1)) {
-        mapSearchState = MapSearchState(x, y+1);
-        aStarSearch->addSuccessor(mapSearchState);
+    unsigned int mask = neighbourMasks[(y * MAP_WIDTH) + x] & (diagonalMovement ? 0xFF : 0x0F);
+    while (mask) {
+        int direction = __builtin_ctz(mask);
+        mask &= mask - 1;
+        int nx = x + DIRECTION_X[direction];
+        int ny = y + DIRECTION_Y[direction];
+        if (nx == parentX && ny == parentY) continue;
+        if (!successorSink->emplaceSuccessor(nx, ny)) return false;
     }
     return true;
 }
 
 float MapSearchState::getCost(MapSearchState &successor) {
+    if (successor.x != x && successor.y != y) return (float) getMap(x, y) * (float) M_SQRT2;
     return (float) getMap(x, y);
 }
 
@@ -118,6 +407,43 @@ bool MapSearchState::isSameState(MapSearchState &rhs) {
     return x == rhs.x && y == rhs.y;
 }
 
+bool MapSearchState::isReachable(MapSearchState &nodeGoal) {
+    if (isGoal(nodeGoal)) return true;
+    if (getMap(nodeGoal.x, nodeGoal.y) >= 9) return false;
+    lock_guard<mutex> lock(componentsMutex);
+    if (componentsDirty) buildComponents();
+    int goalLabel = componentLabels[(nodeGoal.y * MAP_WIDTH) + nodeGoal.x];
+    if (getMap(x, y) < 9) return componentLabels[(y * MAP_WIDTH) + x] == goalLabel;
+    // A search may start on a blocked cell, and it still moves from there to the free cells around it.
+    for (int direction = 0; direction < 4; direction++) {
+        int nx = x + DIRECTION_X[direction];
+        int ny = y + DIRECTION_Y[direction];
+        if (getMap(nx, ny) < 9 && componentLabels[(ny * MAP_WIDTH) + nx] == goalLabel) return true;
+    }
+    return false;
+}
+
+unsigned int MapSearchState::rank() {
+    return (y * MAP_WIDTH) + x;
+}
+
+unsigned int MapSearchState::rankBound() {
+    return MAP_WIDTH * MAP_HEIGHT;
+}
+
+void MapSearchState::pack(unsigned char *record) {
+    // Big-endian, so records sort by row and then by column.
+    record[0] = (unsigned char) (y >> 8);
+    record[1] = (unsigned char) y;
+    record[2] = (unsigned char) (x >> 8);
+    record[3] = (unsigned char) x;
+}
+
+void MapSearchState::unpack(const unsigned char *record) {
+    y = (record[0] << 8) | record[1];
+    x = (record[2] << 8) | record[3];
+}
+
 void MapSearchState::printNodeInfo() {
     char str[100];
     sprintf(str, "Node position: (%d,%d)", x, y);
@@ -17,7 +17,7 @@
 int main(int argc, char *argv[]) {
     for (int i = 0; i < MAX_CITIES; i++) {
         for (int j = 0; j < MAX_CITIES; j++) {
-            romaniaMap[i][j] = -1.0f;
+            romaniaMap[i][j] = -1;
         }
     }
 
@@ -33,9 +33,9 @@ enum CITIES {
 
 vector<string> cityNames(MAX_CITIES);
 
-float romaniaMap[MAX_CITIES][MAX_CITIES];
+int romaniaMap[MAX_CITIES][MAX_CITIES];
 
-class PathSearchState : public AStarState<PathSearchState> {
+class PathSearchState : public AStarState<PathSearchState, int> {
 
 public:
 
@@ -45,19 +45,46 @@ public:
 
     explicit PathSearchState(CITIES in);
 
-    float goalDistanceEstimate(PathSearchState &nodeGoal) override;
+    int goalDistanceEstimate(PathSearchState &nodeGoal) override;
 
     bool isGoal(PathSearchState &nodeGoal) override;
 
-    bool getSuccessors(AStarSearch<PathSearchState> *aStarSearch, PathSearchState *parentNode) override;
+    bool getSuccessors(SuccessorSink<PathSearchState> *successorSink, PathSearchState *parentNode) override;
 
-    float getCost(PathSearchState &successor) override;
+    int getCost(PathSearchState &successor) override;
 
     bool isSameState(PathSearchState &rhs) override;
 
+    bool isReachable(PathSearchState &nodeGoal);
+
+    static void setRoad(CITIES from, CITIES to, int distance);
+
+    unsigned int rank();
+
+    unsigned int rankBound();
+
     void printNodeInfo();
+
+private:
+
+    static bool componentsDirty;
+
+    static int componentOf[MAX_CITIES];
+    static unsigned int reachableComponents[MAX_CITIES];
+
+    static void buildComponents();
+
+    static void connectComponents(int city, int &index, int *indices, int *lowLinks, vector<int> &stack,
+                                  int &componentCount);
 };
 
+static_assert(MAX_CITIES <= 32, "the components reachable from a component are a 32 bit mask");
+
+bool PathSearchState::componentsDirty = true;
+
+int PathSearchState::componentOf[];
+unsigned int PathSearchState::reachableComponents[];
+
 PathSearchState::PathSearchState() {
     city = Arad;
 }
@@ -66,7 +93,7 @@ PathSearchState::PathSearchState(CITIES city) {
     this->city = city;
 }
 
-float PathSearchState::goalDistanceEstimate(PathSearchState &nodeGoal) {
+int PathSearchState::goalDistanceEstimate(PathSearchState &nodeGoal) {
     switch(city) {
         case Arad:return 366;
         case Bucharest: return 0;
@@ -88,7 +115,7 @@ float PathSearchState::goalDistanceEstimate(PathSearchState &nodeGoal) {
         case Urziceni: return 80;
         case Vaslui: return 199;
         case Zerind: return 374;
-        default: return 0.0f;
+        default: return 0;
     }
 }
 
@@ -96,17 +123,16 @@ bool PathSearchState::isGoal(PathSearchState &nodeGoal) {
     return city == Bucharest;
 }
 
-bool PathSearchState::getSuccessors(AStarSearch<PathSearchState> *aStarSearch, PathSearchState *parentNode) {
-    PathSearchState pathSearchState;
+bool PathSearchState::getSuccessors(SuccessorSink<PathSearchState> *successorSink, PathSearchState *parentNode) {
     for (int c = 0; c < MAX_CITIES; c++) {
         if (romaniaMap[city][c] < 0) continue;
-        pathSearchState = PathSearchState((CITIES)c);
-        aStarSearch->addSuccessor(pathSearchState);
+        if (parentNode && parentNode->city == c) continue;
+        if (!successorSink->emplaceSuccessor((CITIES) c)) return false;
     }
     return true;
 }
 
-float PathSearchState::getCost(PathSearchState &successor) {
+int PathSearchState::getCost(PathSearchState &successor) {
     return romaniaMap[city][successor.city];
 }
 
@@ -114,6 +140,72 @@ bool PathSearchState::isSameState(PathSearchState &rhs) {
     return city == rhs.city;
 }
 
+bool PathSearchState::isReachable(PathSearchState &nodeGoal) {
+    if (componentsDirty) buildComponents();
+    // The goal is always Bucharest, as in isGoal().
+    return (reachableComponents[componentOf[city]] >> componentOf[Bucharest]) & 1;
+}
+
+void PathSearchState::setRoad(CITIES from, CITIES to, int distance) {
+    romaniaMap[from][to] = distance;
+    componentsDirty = true;
+}
+
+void PathSearchState::buildComponents() {
+    int indices[MAX_CITIES];
+    int lowLinks[MAX_CITIES];
+    vector<int> stack;
+    int index = 0;
+    int componentCount = 0;
+    for (int c = 0; c < MAX_CITIES; c++) indices[c] = -1;
+    for (int c = 0; c < MAX_CITIES; c++) {
+        if (indices[c] < 0) connectComponents(c, index, indices, lowLinks, stack, componentCount);
+    }
+    // Tarjan numbers a component only after every component it reaches, so one pass in that order closes the roads.
+    for (int component = 0; component < componentCount; component++) {
+        reachableComponents[component] = 1u << component;
+        for (int from = 0; from < MAX_CITIES; from++) {
+            if (componentOf[from] != component) continue;
+            for (int to = 0; to < MAX_CITIES; to++) {
+                if (romaniaMap[from][to] >= 0) reachableComponents[component] |= reachableComponents[componentOf[to]];
+            }
+        }
+    }
+    componentsDirty = false;
+}
+
+void PathSearchState::connectComponents(int city, int &index, int *indices, int *lowLinks, vector<int> &stack,
+                                        int &componentCount) {
+    indices[city] = lowLinks[city] = index++;
+    stack.push_back(city);
+    componentOf[city] = -1;
+    for (int c = 0; c < MAX_CITIES; c++) {
+        if (romaniaMap[city][c] < 0) continue;
+        if (indices[c] < 0) {
+            connectComponents(c, index, indices, lowLinks, stack, componentCount);
+            lowLinks[city] = min(lowLinks[city], lowLinks[c]);
+        } else if (componentOf[c] < 0) {
+            lowLinks[city] = min(lowLinks[city], indices[c]);
+        }
+    }
+    if (lowLinks[city] != indices[city]) return;
+    int member;
+    do {
+        member = stack.back();
+        stack.pop_back();
+        componentOf[member] = componentCount;
+    } while (member != city);
+    componentCount++;
+}
+
+unsigned int PathSearchState::rank() {
+    return city;
+}
+
+unsigned int PathSearchState::rankBound() {
+    return MAX_CITIES;
+}
+
 void PathSearchState::printNodeInfo() {
     cout << " " << cityNames[city] << endl;
 }